@@ -0,0 +1,188 @@
+/**
+ * ARC implementation
+ */
+#include <algorithm>
+
+#include "buffer/arc_replacer.h"
+#include "buffer/frame_id.h"
+#include "page/page.h"
+
+namespace scudb {
+
+template <typename T> bool ARCReplacer<T>::Ghost::Take(page_id_t key) {
+  auto it = index.find(key);
+  if(it == index.end()){
+    return false;
+  }
+  keys.erase(it->second);
+  index.erase(it);
+  return true;
+}
+
+template <typename T> void ARCReplacer<T>::Ghost::Push(page_id_t key) {
+  Take(key);
+  keys.push_front(key);
+  index[key] = keys.begin();
+}
+
+template <typename T> void ARCReplacer<T>::Ghost::DropOldest() {
+  index.erase(keys.back());
+  keys.pop_back();
+}
+
+template <typename T>
+ARCReplacer<T>::ARCReplacer(size_t capacity,
+                            std::function<page_id_t(const T &)> key)
+    : capacity(std::max<size_t>(capacity, 1)), key(key), target(0),
+      values(2), keys(2, INVALID_PAGE_ID), list(2, NONE), linked(2, false),
+      evictable(0) {
+  // empty circular lists: T1 sentinel is slot 0, T2 sentinel slot 1
+  prev = {0, 1};
+  next = {0, 1};
+  count[NONE] = count[T1] = count[T2] = 0;
+}
+
+template <typename T> ARCReplacer<T>::~ARCReplacer() {}
+
+/*
+ * Put slot at the most recent end of its list
+ */
+template <typename T> void ARCReplacer<T>::Link(size_t slot) {
+  size_t head = list[slot] == T1 ? 0 : 1;
+  prev[slot] = head;
+  next[slot] = next[head];
+  prev[next[head]] = slot;
+  next[head] = slot;
+  linked[slot] = true;
+  evictable++;
+}
+
+template <typename T> void ARCReplacer<T>::Unlink(size_t slot) {
+  next[prev[slot]] = next[slot];
+  prev[next[slot]] = prev[slot];
+  linked[slot] = false;
+  evictable--;
+}
+
+/*
+ * Keep |T1| + |B1| <= c and |T1| + |T2| + |B1| + |B2| <= 2c
+ */
+template <typename T> void ARCReplacer<T>::TrimGhosts() {
+  while(b1.Size() > 0 && count[T1] + b1.Size() > capacity){
+    b1.DropOldest();
+  }
+  while(b2.Size() > 0 &&
+        count[T1] + count[T2] + b1.Size() + b2.Size() > 2 * capacity){
+    b2.DropOldest();
+  }
+}
+
+/*
+ * An access to value. Seen before with the same page id: a hit, it moves to
+ * T2. Otherwise a miss: a key found in a ghost list adapts the target and
+ * goes to T2, any other key to T1.
+ */
+template <typename T> void ARCReplacer<T>::Insert(const T &value) {
+  std::lock_guard<std::mutex> lck(latch);
+  page_id_t page_id = key(value);
+  size_t slot;
+  if(!slots.Find(value, slot)){
+    slot = values.size();
+    slots.Add(value, slot);
+    values.push_back(value);
+    keys.push_back(INVALID_PAGE_ID);
+    list.push_back(NONE);
+    linked.push_back(false);
+    prev.push_back(slot);
+    next.push_back(slot);
+  }
+  if(linked[slot]){
+    Unlink(slot);
+  }
+  if(list[slot] != NONE){
+    count[list[slot]]--;
+  }
+  if(list[slot] != NONE && keys[slot] == page_id){
+    list[slot] = T2;
+  }else{
+    // a frame reused without Victim forgets its old page
+    keys[slot] = page_id;
+    size_t b1_size = std::max<size_t>(b1.Size(), 1);
+    size_t b2_size = std::max<size_t>(b2.Size(), 1);
+    if(b1.Take(page_id)){
+      target = std::min(capacity, target + std::max<size_t>(b2_size / b1_size, 1));
+      list[slot] = T2;
+    }else if(b2.Take(page_id)){
+      size_t step = std::max<size_t>(b1_size / b2_size, 1);
+      target = target > step ? target - step : 0;
+      list[slot] = T2;
+    }else{
+      list[slot] = T1;
+    }
+  }
+  count[list[slot]]++;
+  Link(slot);
+  TrimGhosts();
+}
+
+/*
+ * Evict the least recent evictable value of T1 if T1 is over its target (or
+ * T2 has nothing to give), else of T2, remembering its page id in the
+ * matching ghost list.
+ */
+template <typename T> bool ARCReplacer<T>::Victim(T &value) {
+  std::lock_guard<std::mutex> lck(latch);
+  if(evictable == 0){
+    return false;
+  }
+  bool t1_has = next[0] != 0, t2_has = next[1] != 1;
+  bool from_t1 = t1_has && (count[T1] > target || !t2_has);
+  size_t slot = from_t1 ? prev[0] : prev[1];
+  Unlink(slot);
+  count[list[slot]]--;
+  if(from_t1){
+    b1.Push(keys[slot]);
+  }else{
+    b2.Push(keys[slot]);
+  }
+  list[slot] = NONE;
+  keys[slot] = INVALID_PAGE_ID;
+  TrimGhosts();
+  value = values[slot];
+  return true;
+}
+
+/*
+ * value got pinned: off its list until the next Insert
+ */
+template <typename T> bool ARCReplacer<T>::Erase(const T &value) {
+  std::lock_guard<std::mutex> lck(latch);
+  size_t slot;
+  if(!slots.Find(value, slot) || !linked[slot]){
+    return false;
+  }
+  Unlink(slot);
+  return true;
+}
+
+template <typename T> size_t ARCReplacer<T>::Size() {
+  std::lock_guard<std::mutex> lck(latch);
+  return evictable;
+}
+
+/*
+ * Called after the frames were added or retired, so the resident values
+ * already fit; p and the ghost lists are cut down to the new size.
+ */
+template <typename T> void ARCReplacer<T>::SetCapacity(size_t capacity) {
+  std::lock_guard<std::mutex> lck(latch);
+  this->capacity = std::max<size_t>(capacity, 1);
+  target = std::min(target, this->capacity);
+  TrimGhosts();
+}
+
+template class ARCReplacer<Page *>;
+// frame ids of the buffer pool, also what the tests use
+template class ARCReplacer<frame_id_t>;
+
+} // namespace scudb
@@ -0,0 +1,88 @@
+/**
+ * arc_replacer.h
+ *
+ * Functionality: Adaptive Replacement Cache. Resident values live in T1
+ * (used once since they were loaded) or T2 (used again). The keys (page ids)
+ * of values recently evicted from them are remembered in the ghost lists B1
+ * and B2. A value loaded again while its key is in B1 means T1 was too
+ * small, in B2 that T2 was; either way the target size p of T1 moves
+ * towards the list that would have kept it, and Victim evicts from T1 when
+ * it holds more than p values, from T2 otherwise.
+ *
+ * Mapping onto the Replacer interface: Insert (the unpin ending a use) is
+ * the access. Erase is what BufferPoolManager calls for a page that got
+ * pinned since it was inserted; it only takes the value off its list until
+ * the next Insert,
+ * the value stays counted in T1/T2. A value whose key changed since it
+ * was last seen (its frame was reused without Victim, e.g. after a delete)
+ * starts over as a new value.
+ */
+
+#pragma once
+
+#include <functional>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "buffer/replacer.h"
+#include "buffer/slot_map.h"
+#include "common/config.h"
+
+using namespace std;
+namespace scudb {
+
+template <typename T> class ARCReplacer : public Replacer<T> {
+public:
+  // capacity: number of frames the replacer serves, key: the page id a
+  // value holds at the time of the call
+  ARCReplacer(size_t capacity, std::function<page_id_t(const T &)> key);
+
+  ~ARCReplacer();
+
+  void Insert(const T &value);
+
+  bool Victim(T &value);
+
+  bool Erase(const T &value);
+
+  size_t Size();
+
+  // the number of frames served changed (BufferPoolManager::Resize)
+  void SetCapacity(size_t capacity);
+
+private:
+  enum ListId { NONE = 0, T1, T2 };
+  // ghost list of page ids, most recent at the front
+  struct Ghost {
+    std::list<page_id_t> keys;
+    std::unordered_map<page_id_t, std::list<page_id_t>::iterator> index;
+    bool Take(page_id_t key);
+    void Push(page_id_t key);
+    void DropOldest();
+    size_t Size() const { return keys.size(); }
+  };
+
+  void Link(size_t slot);
+  void Unlink(size_t slot);
+  void TrimGhosts();
+
+  size_t capacity;
+  std::function<page_id_t(const T &)> key;
+  size_t target;  // p, the size T1 is aimed at
+  // slots 0 and 1 are the sentinels of the T1 and T2 lists (next: most
+  // recent, prev: least recent); slots are never given back
+  SlotMap<T> slots;
+  std::vector<T> values;
+  std::vector<page_id_t> keys;   // page id the slot had when last seen
+  std::vector<ListId> list;      // list the slot belongs to
+  std::vector<bool> linked;      // on its list, i.e. evictable
+  std::vector<size_t> prev;
+  std::vector<size_t> next;
+  size_t count[3];               // values per list, pinned ones included
+  size_t evictable;
+  Ghost b1, b2;
+  mutable std::mutex latch;
+};
+
+} // namespace scudb
@@ -1,60 +1,641 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <new>
+#include <sstream>
+#include <vector>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
 #include "buffer/buffer_pool_manager.h"
 
 namespace scudb {
 
+// how often the background writer wakes up
+static const std::chrono::milliseconds FLUSHER_INTERVAL(10);
+// longest run of consecutive pages a checkpoint writes in one go
+static const size_t MAX_WRITE_RUN = 32;
+// number of read-ahead worker threads
+static const size_t PREFETCH_THREADS = 2;
+// first word of a resident page file written by SaveResidentPages
+static const uint32_t RESIDENT_FILE_MAGIC = 0x53504d42;
+// size of the huge pages the frame arena asks for
+static const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+// frames an instance notes before handing them to its replacer
+static const size_t ACCESS_BUFFER_SIZE = 64;
+
+/*
+ * Map an anonymous arena of at least bytes for the frames. Arenas of a huge
+ * page or more try explicit huge pages (MAP_HUGETLB) first, then a normal
+ * mapping aligned to HUGE_PAGE_SIZE with madvise(MADV_HUGEPAGE) so that
+ * transparent huge pages can back it. Smaller arenas just get normal pages.
+ * length returns the size of the mapping, for munmap.
+ */
+static void *MapFrameArena(size_t bytes, size_t &length) {
+  size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  bool huge = bytes >= HUGE_PAGE_SIZE;
+  size_t align = huge ? HUGE_PAGE_SIZE : page_size;
+  length = std::max(align, (bytes + align - 1) / align * align);
+  void *arena = MAP_FAILED;
+#ifdef MAP_HUGETLB
+  if (huge) {
+    arena = mmap(nullptr, length, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (arena != MAP_FAILED) return arena;
+  }
+#endif
+  // over-map by one alignment unit and trim both ends to align the start
+  size_t padded = huge ? length + HUGE_PAGE_SIZE : length;
+  arena = mmap(nullptr, padded, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (arena == MAP_FAILED) {
+    throw std::bad_alloc();
+  }
+  if (huge) {
+    char *base = static_cast<char *>(arena);
+    size_t head = (HUGE_PAGE_SIZE - reinterpret_cast<uintptr_t>(base) % HUGE_PAGE_SIZE) %
+                  HUGE_PAGE_SIZE;
+    if (head > 0) munmap(base, head);
+    if (padded - head > length) munmap(base + head + length, padded - head - length);
+    arena = base + head;
+#ifdef MADV_HUGEPAGE
+    madvise(arena, length, MADV_HUGEPAGE);
+#endif
+  }
+  return arena;
+}
+
+// frames: number of frames the replacer serves, key: page id in a frame
+static Replacer<frame_id_t> *
+MakeReplacer(ReplacerPolicy policy, size_t frames,
+             std::function<page_id_t(const frame_id_t &)> key) {
+  switch (policy) {
+  case ReplacerPolicy::CLOCK:
+    return new ClockReplacer<frame_id_t>;
+  case ReplacerPolicy::LRU_K:
+    return new LRUKReplacer<frame_id_t>(2, 32, key);
+  case ReplacerPolicy::ARC:
+    return new ARCReplacer<frame_id_t>(frames, key);
+  case ReplacerPolicy::TINY_LFU:
+    return new TinyLFUReplacer<frame_id_t>(frames, key);
+  case ReplacerPolicy::LRU:
+  default:
+    return new LRUReplacer<frame_id_t>;
+  }
+}
+
+// tell a replacer made by MakeReplacer(policy, ...) that it now serves frames
+static void ResizeReplacer(ReplacerPolicy policy, Replacer<frame_id_t> *replacer,
+                           size_t frames) {
+  switch (policy) {
+  case ReplacerPolicy::ARC:
+    static_cast<ARCReplacer<frame_id_t> *>(replacer)->SetCapacity(frames);
+    break;
+  case ReplacerPolicy::TINY_LFU:
+    static_cast<TinyLFUReplacer<frame_id_t> *>(replacer)->SetCapacity(frames);
+    break;
+  default:
+    // the others have no notion of capacity
+    break;
+  }
+}
+
 /*
  * BufferPoolManager Constructor
  * When log_manager is nullptr, logging is disabled (for test purpose)
- * WARNING: Do Not Edit This Function
+ * num_instances: number of independent partitions, clamped to [1, pool_size]
+ * max_pool_size: largest size Resize() may grow the pool to, address space
+ * for that many frames is reserved up front (0: pool_size)
+ * policy: replacer used by the instances
  */
 BufferPoolManager::BufferPoolManager(size_t pool_size,
                                                  DiskManager *disk_manager,
-                                                 LogManager *log_manager)
-    : pool_size_(pool_size), disk_manager_(disk_manager),
-      log_manager_(log_manager) {
-  // a consecutive memory space for buffer pool
-  pages_ = new Page[pool_size_];
-  page_table_ = new ExtendibleHash<page_id_t, Page *>(BUCKET_SIZE);
-  replacer_ = new LRUReplacer<Page *>;
-  free_list_ = new std::list<Page *>;
+                                                 LogManager *log_manager,
+                                                 size_t num_instances,
+                                                 size_t max_pool_size,
+                                                 ReplacerPolicy policy)
+    : pool_size_(pool_size), num_instances_(num_instances),
+      capacity_(std::max(pool_size, max_pool_size)), constructed_(pool_size),
+      policy_(policy), disk_manager_(disk_manager), log_manager_(log_manager) {
+  if (num_instances_ == 0) num_instances_ = 1;
+  if (pool_size > 0 && num_instances_ > pool_size) num_instances_ = pool_size;
+  // a consecutive memory space for buffer pool, see MapFrameArena. Frames
+  // past pool_size are constructed when Resize needs them.
+  void *arena = MapFrameArena(capacity_ * sizeof(Page), arena_length_);
+  pages_ = static_cast<Page *>(arena);
+  for (size_t i = 0; i < pool_size; ++i) {
+    new (&pages_[i]) Page();
+  }
+  frames_ = new FrameHeader[capacity_];
+  instances_ = new BufferPoolInstance[num_instances_];
+  for (size_t i = 0; i < num_instances_; ++i) {
+    // sized for the largest the instance can get through Resize
+    size_t max_frames = (capacity_ + num_instances_ - 1 - i) / num_instances_;
+    instances_[i].page_table_ = new PageTable(max_frames);
+    instances_[i].free_list_ = new std::deque<frame_id_t>;
+    instances_[i].num_frames_ = (pool_size + num_instances_ - 1 - i) / num_instances_;
+    instances_[i].replacer_ = MakeReplacer(
+        policy, instances_[i].num_frames_, [this, i](const frame_id_t &frame_id) {
+          return pages_[frame_id * num_instances_ + i].GetPageId();
+        });
+    instances_[i].dirty_bitmap_.assign((max_frames + 63) / 64, 0);
+  }
 
-  // put all the pages into free list
-  for (size_t i = 0; i < pool_size_; ++i) {
-    free_list_->push_back(&pages_[i]);
+  // put all the pages into the free list of the instance owning them
+  for (size_t i = 0; i < pool_size; ++i) {
+    instances_[i % num_instances_].free_list_->push_back(FrameId(&pages_[i]));
   }
 }
 
 /*
  * BufferPoolManager Deconstructor
- * WARNING: Do Not Edit This Function
  */
 BufferPoolManager::~BufferPoolManager() {
-  delete[] pages_;
-  delete page_table_;
-  delete replacer_;
-  delete free_list_;
+  StopBackgroundFlusher();
+  {
+    lock_guard<mutex> lck(prefetch_latch_);
+    prefetch_stop_ = true;
+  }
+  prefetch_cv_.notify_all();
+  for (std::thread &t : prefetchers_) {
+    t.join();
+  }
+  for (size_t i = 0; i < num_instances_; ++i) {
+    delete instances_[i].page_table_;
+    delete instances_[i].replacer_;
+    delete instances_[i].free_list_;
+  }
+  delete[] instances_;
+  delete[] frames_;
+  for (size_t i = 0; i < constructed_; ++i) {
+    pages_[i].~Page();
+  }
+  munmap(pages_, arena_length_);
+}
+
+/*
+ * BufferAccessStrategy: ring_size is split evenly over the instances since
+ * every page can only be loaded into a frame of its own instance
+ */
+BufferAccessStrategy::BufferAccessStrategy(BufferPoolManager *buffer_pool_manager,
+                                           size_t ring_size)
+    : buffer_pool_manager_(buffer_pool_manager) {
+  size_t num_instances = buffer_pool_manager_->num_instances_;
+  ring_size_ = std::max<size_t>(1, (ring_size + num_instances - 1) / num_instances);
+  rings_.resize(num_instances);
+  hands_.assign(num_instances, 0);
+}
+
+BufferAccessStrategy::~BufferAccessStrategy() {
+  for (size_t i = 0; i < rings_.size(); ++i) {
+    BufferPoolManager::BufferPoolInstance &instance =
+        buffer_pool_manager_->instances_[i];
+    unique_lock<mutex> lck(instance.latch_, std::defer_lock);
+    buffer_pool_manager_->LatchInstance(instance, lck);
+    for (Page *page : rings_[i]) {
+      buffer_pool_manager_->ReleaseRingFrame(instance, page);
+    }
+  }
+}
+
+/*
+ * Change the number of frames in service to new_size (at most the
+ * max_pool_size given to the constructor) while the pool keeps serving.
+ * Every instance gets its share of new_size. Growing puts frames retired
+ * earlier, then frames not used so far, onto the free lists. Shrinking takes
+ * victims the way a miss would (free list first, then the replacer),
+ * writes them back if dirty and retires them; pinned frames are never
+ * taken, so an instance whose frames are all pinned stays bigger.
+ * Returns the resulting pool size.
+ */
+size_t BufferPoolManager::Resize(size_t new_size) {
+  lock_guard<mutex> resize_lck(resize_latch_);
+  new_size = std::min(new_size, capacity_);
+  std::vector<size_t> targets(num_instances_);
+  for (size_t i = 0; i < num_instances_; ++i) {
+    targets[i] = (new_size + num_instances_ - 1 - i) / num_instances_;
+  }
+
+  // construct new frames until every instance has enough to grow into;
+  // frame i belongs to instance i % num_instances_
+  while (constructed_ < capacity_) {
+    bool short_of_frames = false;
+    for (size_t i = 0; i < num_instances_ && !short_of_frames; ++i) {
+      unique_lock<mutex> lck(instances_[i].latch_, std::defer_lock);
+      LatchInstance(instances_[i], lck);
+      short_of_frames = instances_[i].num_frames_ +
+                            instances_[i].retired_.size() < targets[i];
+    }
+    if (!short_of_frames) break;
+    Page *page = new (&pages_[constructed_]) Page();
+    BufferPoolInstance &instance = instances_[constructed_ % num_instances_];
+    unique_lock<mutex> lck(instance.latch_, std::defer_lock);
+    LatchInstance(instance, lck);
+    instance.retired_.push_back(page);
+    constructed_++;
+  }
+
+  size_t total = 0;
+  for (size_t i = 0; i < num_instances_; ++i) {
+    BufferPoolInstance &instance = instances_[i];
+    unique_lock<mutex> lck(instance.latch_, std::defer_lock);
+    LatchInstance(instance, lck);
+    while (instance.num_frames_ < targets[i] && !instance.retired_.empty()) {
+      instance.free_list_->push_back(FrameId(instance.retired_.back()));
+      instance.retired_.pop_back();
+      instance.num_frames_++;
+    }
+    while (instance.num_frames_ > targets[i] && RetireFrame(instance, lck)) {
+    }
+    ResizeReplacer(policy_, instance.replacer_, instance.num_frames_);
+    total += instance.num_frames_;
+  }
+  pool_size_ = total;
+  return total;
+}
+
+/*
+ * Take one victim of instance out of service, latch held. A dirty victim is
+ * written back first; if it gets pinned during the write it is left to its
+ * user and another victim is tried. Returns false if no victim is left.
+ */
+bool BufferPoolManager::RetireFrame(BufferPoolInstance &instance,
+                                    unique_lock<mutex> &lck) {
+  while (true) {
+    bool released = false;
+    Page *tar = GetVictimPage(instance, lck, released);
+    if (tar == nullptr) return false;
+    if (tar->is_dirty_) {
+      instance.stats_.foreground_writes++;
+      WriteBackFrame(instance, lck, tar);
+      // it may have been pinned, and even unpinned again, meanwhile
+      instance.replacer_->Erase(FrameId(tar));
+      if (tar->GetPinCount() > 0) continue;
+      if (tar->is_dirty_) {
+        instance.replacer_->Insert(FrameId(tar));
+        continue;
+      }
+    }
+    if (tar->GetPageId() != INVALID_PAGE_ID) {
+      instance.stats_.evictions++;
+      instance.page_table_->Remove(tar->GetPageId());
+      tar->page_id_ = INVALID_PAGE_ID;
+    }
+    instance.retired_.push_back(tar);
+    instance.num_frames_--;
+    return true;
+  }
+}
+
+/*
+ * pages are routed to instances by page_id, so the same page always lives in
+ * the same instance
+ */
+BufferPoolManager::BufferPoolInstance &
+BufferPoolManager::GetInstance(page_id_t page_id) {
+  return instances_[static_cast<size_t>(page_id) % num_instances_];
+}
+
+BufferPoolManager::FrameHeader &BufferPoolManager::GetFrame(Page *page) {
+  return frames_[page - pages_];
+}
+
+/*
+ * Replacers and free lists work on frame ids: frame i of the pool is frame
+ * i / num_instances_ of instance i % num_instances_, so the ids of every
+ * instance are dense from 0.
+ */
+frame_id_t BufferPoolManager::FrameId(Page *page) const {
+  return static_cast<frame_id_t>((page - pages_) / num_instances_);
+}
+
+Page *BufferPoolManager::FramePage(BufferPoolInstance &instance,
+                                   frame_id_t frame_id) const {
+  return &pages_[frame_id * num_instances_ + (&instance - instances_)];
+}
+
+/*
+ * Take the latch of instance through lck (constructed with std::defer_lock
+ * or unlocked). Only a failed try_lock is timed, so the uncontended path
+ * costs one counter increment.
+ */
+void BufferPoolManager::LatchInstance(BufferPoolInstance &instance,
+                                      unique_lock<mutex> &lck) {
+  if (lck.try_lock()) {
+    instance.stats_.latch_waits[0]++;
+    return;
+  }
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  lck.lock();
+  int64_t waited = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - start).count();
+  size_t bucket = 1;
+  for (int64_t limit = 4; waited >= limit && bucket + 1 < Stats::LATCH_BUCKETS;
+       limit *= 4) {
+    bucket++;
+  }
+  instance.stats_.latch_waits[bucket]++;
+}
+
+/*
+ * The replacer learns about pins and unpins in batches: the first pin of an
+ * unpinned page and the unpin to zero only note the frame in the access
+ * buffer of its instance, at most once until the buffer is handed to the
+ * replacer, when it fills up or before a victim is chosen. Hits take no
+ * replacer latch.
+ * The drain tells the replacer where each noted frame stands now: a pinned
+ * one is erased, an unpinned one inserted, which is one access per pin/unpin
+ * cycle however many times the frame was noted meanwhile. A frame pinned
+ * since it was inserted is therefore still in the replacer until the next
+ * drain, but Victim only runs right after one.
+ * Both run with the instance latch held.
+ */
+void BufferPoolManager::RecordAccess(BufferPoolInstance &instance, Page *page) {
+  FrameHeader &frame = GetFrame(page);
+  if (frame.buffered_) return;
+  frame.buffered_ = true;
+  instance.access_buffer_.push_back(FrameId(page));
+  if (instance.access_buffer_.size() >= ACCESS_BUFFER_SIZE) {
+    DrainAccesses(instance);
+  }
+}
+
+void BufferPoolManager::DrainAccesses(BufferPoolInstance &instance) {
+  for (frame_id_t frame_id : instance.access_buffer_) {
+    Page *page = FramePage(instance, frame_id);
+    FrameHeader &frame = GetFrame(page);
+    frame.buffered_ = false;
+    // skip frames deleted, retired or taken by a ring since, they are not
+    // in the replacer
+    if (page->GetPageId() == INVALID_PAGE_ID || frame.ring_ != nullptr) {
+      continue;
+    }
+    if (page->GetPinCount() > 0) {
+      instance.replacer_->Erase(frame_id);
+    } else {
+      instance.replacer_->Insert(frame_id);
+    }
+  }
+  instance.access_buffer_.clear();
+}
+
+/*
+ * Pin tar once more, instance latch held. A page going from unpinned to
+ * pinned is noted for the replacer, see RecordAccess.
+ */
+void BufferPoolManager::PinFrame(BufferPoolInstance &instance, Page *tar) {
+  if (tar->pin_count_++ == 0) {
+    if (GetFrame(tar).ring_ == nullptr) {
+      RecordAccess(instance, tar);
+    }
+    GetFrame(tar).pin_lsn_ = tar->GetLSN();
+    Stats &stats = instance.stats_;
+    if (++stats.pinned_frames > stats.pinned_high_water) {
+      stats.pinned_high_water = stats.pinned_frames;
+    }
+  }
+}
+
+/*
+ * Dirty page table maintenance. Callers hold the latch of the instance that
+ * owns the frame. first_dirty_lsn_ is only recorded on the clean to dirty
+ * transition. The page is only marked dirty when it is unpinned, after the
+ * changes, so its LSN then belongs to the last change; the LSN it had when
+ * the pin began is not above the first one, so redo starting there misses
+ * nothing.
+ */
+void BufferPoolManager::SetDirty(Page *page) {
+  if (page->is_dirty_) return;
+  size_t frame_id = page - pages_;
+  BufferPoolInstance &instance = instances_[frame_id % num_instances_];
+  size_t bit = frame_id / num_instances_;
+  page->is_dirty_ = true;
+  instance.dirty_bitmap_[bit / 64] |= 1ULL << (bit % 64);
+  instance.dirty_count_++;
+  frames_[frame_id].first_dirty_lsn_ = frames_[frame_id].pin_lsn_;
+}
+
+void BufferPoolManager::ClearDirty(Page *page) {
+  if (!page->is_dirty_) return;
+  size_t frame_id = page - pages_;
+  BufferPoolInstance &instance = instances_[frame_id % num_instances_];
+  size_t bit = frame_id / num_instances_;
+  page->is_dirty_ = false;
+  instance.dirty_bitmap_[bit / 64] &= ~(1ULL << (bit % 64));
+  instance.dirty_count_--;
+  frames_[frame_id].first_dirty_lsn_ = INVALID_LSN;
+}
+
+/*
+ * Walk the dirty bitmap of instance index, skipping clean words whole.
+ */
+void BufferPoolManager::CollectDirty(size_t index, std::vector<Page *> &dirty) {
+  const std::vector<uint64_t> &bitmap = instances_[index].dirty_bitmap_;
+  for (size_t w = 0; w < bitmap.size(); ++w) {
+    for (uint64_t bits = bitmap[w]; bits != 0; bits &= bits - 1) {
+      size_t bit = w * 64 + __builtin_ctzll(bits);
+      dirty.push_back(&pages_[index + bit * num_instances_]);
+    }
+  }
 }
 
-Page *BufferPoolManager::GetVictimPage(){
+/*
+ * Search the page table for page_id. If disk I/O is running on the frame
+ * holding it, sleep on that frame until the I/O is over and look again, as
+ * the page may have been moved or dropped in the meantime.
+ * return nullptr if the page is not in the buffer pool
+ */
+Page *BufferPoolManager::FindPage(BufferPoolInstance &instance,
+                                  unique_lock<mutex> &lck, page_id_t page_id) {
   Page *tar = nullptr;
-  // find from free_list_ first
-  if(free_list_->empty()){
-    // if free_list_ is empty then find from replacer_
-    if(replacer_->Size() == 0){
-      // return nullptr if both two are empty
-      return nullptr;
-    }
-    // replacer_ is not empty then choose victim page from replacer_
-    replacer_->Victim(tar);
-  }else{  //free_list_ has empty page object
-    tar = free_list_->front();
-    free_list_->pop_front();
-    // make sure that tar is a free page object
-    assert(tar->GetPageId() == INVALID_PAGE_ID);
-  }
-  // make sure that tar is a unpinned page object
-  assert(tar->GetPinCount() == 0);
-  return tar;
+  while(instance.page_table_->Find(page_id,tar)){
+    FrameHeader &frame = GetFrame(tar);
+    if(!frame.io_in_progress_){
+      return tar;
+    }
+    frame.io_done_.wait(lck);
+  }
+  return nullptr;
+}
+
+/*
+ * Choose a victim frame, free list first. A frame taken from the replacer can
+ * still be in the middle of a write issued by FlushPage; in that case wait
+ * for it, which releases lck, and report that through released.
+ */
+Page *BufferPoolManager::GetVictimPage(BufferPoolInstance &instance,
+                                       unique_lock<mutex> &lck,
+                                       bool &released){
+  released = false;
+  while(true){
+    Page *tar = nullptr;
+    // find from free_list_ first
+    if(instance.free_list_->empty()){
+      // if free_list_ is empty then find from replacer_
+      DrainAccesses(instance);
+      if(instance.replacer_->Size() == 0){
+        // return nullptr if both two are empty
+        return nullptr;
+      }
+      // replacer_ is not empty then choose victim page from replacer_
+      frame_id_t frame_id;
+      instance.replacer_->Victim(frame_id);
+      tar = FramePage(instance, frame_id);
+      instance.stats_.replacer_victims++;
+    }else{  //free_list_ has empty page object
+      tar = FramePage(instance, instance.free_list_->front());
+      instance.free_list_->pop_front();
+      instance.stats_.free_list_victims++;
+      // make sure that tar is a free page object
+      assert(tar->GetPageId() == INVALID_PAGE_ID);
+    }
+    FrameHeader &frame = GetFrame(tar);
+    if(frame.io_in_progress_){
+      released = true;
+      while(frame.io_in_progress_){
+        frame.io_done_.wait(lck);
+      }
+      // somebody may have pinned it (and even unpinned it) while we slept
+      if(tar->GetPinCount() > 0){
+        continue;
+      }
+      instance.replacer_->Erase(FrameId(tar));
+    }
+    // make sure that tar is a unpinned page object
+    assert(tar->GetPinCount() == 0);
+    return tar;
+  }
+}
+
+/*
+ * Reuse the next frame of the ring. While the ring is not full yet, or when
+ * the frame at the hand is still pinned or under I/O, take a frame from the
+ * pool instead; FetchPage puts it into the ring by AddRingFrame once it is
+ * sure to use it.
+ */
+Page *BufferPoolManager::GetRingVictimPage(size_t index, unique_lock<mutex> &lck,
+                                           BufferAccessStrategy *strategy,
+                                           bool &released) {
+  std::vector<Page *> &ring = strategy->rings_[index];
+  size_t &hand = strategy->hands_[index];
+  released = false;
+  if (ring.size() == strategy->ring_size_) {
+    Page *tar = ring[hand];
+    hand = (hand + 1) % ring.size();
+    if (tar->GetPinCount() == 0 && !GetFrame(tar).io_in_progress_) {
+      instances_[index].stats_.ring_victims++;
+      return tar;
+    }
+  }
+  return GetVictimPage(instances_[index], lck, released);
+}
+
+/*
+ * A full ring gives up the busy frame GetRingVictimPage just skipped.
+ */
+void BufferPoolManager::AddRingFrame(size_t index, BufferAccessStrategy *strategy,
+                                     Page *page) {
+  std::vector<Page *> &ring = strategy->rings_[index];
+  GetFrame(page).ring_ = strategy;
+  if (ring.size() < strategy->ring_size_) {
+    ring.push_back(page);
+    return;
+  }
+  size_t slot = (strategy->hands_[index] + ring.size() - 1) % ring.size();
+  ReleaseRingFrame(instances_[index], ring[slot]);
+  ring[slot] = page;
+}
+
+/*
+ * A pinned frame reaches the replacer through UnpinPage as usual.
+ */
+void BufferPoolManager::ReleaseRingFrame(BufferPoolInstance &instance, Page *page) {
+  GetFrame(page).ring_ = nullptr;
+  if (page->GetPinCount() > 0) return;
+  if (page->GetPageId() == INVALID_PAGE_ID) {
+    instance.free_list_->push_back(FrameId(page));
+  } else {
+    RecordAccess(instance, page);
+  }
+}
+
+/*
+ * Hand victim frame tar over to page_id and pin it for the caller.
+ * The frame is marked io_in_progress_ and lck is released while the old
+ * content is written back (if dirty) and the new content is read in (or
+ * zeroed when read_page is false), so cache hits on other frames go on
+ * meanwhile. The old page id stays mapped until its write-back is done;
+ * threads asking for either page id sleep on this frame only.
+ * Returns with lck held.
+ */
+void BufferPoolManager::LoadFrame(BufferPoolInstance &instance,
+                                  unique_lock<mutex> &lck, Page *tar,
+                                  page_id_t page_id, bool read_page) {
+  page_id_t old_page_id = ClaimFrame(instance, tar, page_id);
+  lck.unlock();
+  ReadFrame(tar, old_page_id, read_page);
+  LatchInstance(instance, lck);
+  FinishLoad(instance, tar, old_page_id);
+}
+
+/*
+ * First half of LoadFrame, under the latch. Returns the page id whose
+ * content still has to be written back, INVALID_PAGE_ID if none.
+ */
+page_id_t BufferPoolManager::ClaimFrame(BufferPoolInstance &instance, Page *tar,
+                                        page_id_t page_id) {
+  page_id_t old_page_id = tar->GetPageId();
+  bool write_back = tar->is_dirty_;
+
+  GetFrame(tar).io_in_progress_ = true;
+  instance.page_table_->Insert(page_id,tar);
+  if(!write_back){
+    instance.page_table_->Remove(old_page_id);
+  }
+  if(old_page_id != INVALID_PAGE_ID){
+    instance.stats_.evictions++;
+  }
+  if(write_back){
+    instance.stats_.foreground_writes++;
+  }
+  tar->page_id_ = page_id;
+  PinFrame(instance,tar);
+  ClearDirty(tar);
+  return write_back ? old_page_id : INVALID_PAGE_ID;
+}
+
+/*
+ * Disk I/O of a claimed frame, without the latch.
+ */
+void BufferPoolManager::ReadFrame(Page *tar, page_id_t old_page_id,
+                                  bool read_page) {
+  // If the entry chosen for replacement is dirty, write it back to disk
+  if(old_page_id != INVALID_PAGE_ID){
+    disk_manager_->WritePage(old_page_id,tar->data_);
+  }
+  if(read_page){
+    disk_manager_->ReadPage(tar->GetPageId(),tar->data_);
+  }else{
+    tar->ResetMemory();
+  }
+}
+
+/*
+ * Second half of LoadFrame, under the latch again.
+ */
+void BufferPoolManager::FinishLoad(BufferPoolInstance &instance, Page *tar,
+                                   page_id_t old_page_id) {
+  if(old_page_id != INVALID_PAGE_ID){
+    instance.page_table_->Remove(old_page_id);
+  }
+  FrameHeader &frame = GetFrame(tar);
+  // the frame still held the old content when it was pinned
+  frame.pin_lsn_ = tar->GetLSN();
+  frame.io_in_progress_ = false;
+  frame.io_done_.notify_all();
 }
 
 /**
@@ -67,32 +648,56 @@ Page *BufferPoolManager::GetVictimPage(){
  * entry for the new page.
  * 4. Update page metadata, read page content from disk file and return page
  * pointer
+ * Disk I/O of steps 2 and 4 runs without holding the latch, see LoadFrame.
+ * With a strategy the replacement entry of 1.2 comes from its ring.
+ * INVALID_PAGE_ID marks the empty slots of the page table, it is never
+ * loaded: fetching it returns nullptr.
  */
-Page *BufferPoolManager::FetchPage(page_id_t page_id) {
-  lock_guard<mutex> lck(latch_);
+Page *BufferPoolManager::FetchPage(page_id_t page_id,
+                                   BufferAccessStrategy *strategy) {
+  if (page_id == INVALID_PAGE_ID) {
+    return nullptr;
+  }
+  size_t index = static_cast<size_t>(page_id) % num_instances_;
+  BufferPoolInstance &instance = instances_[index];
+  unique_lock<mutex> lck(instance.latch_, std::defer_lock);
+  LatchInstance(instance, lck);
   Page *tar = nullptr;
-  // 1. search hash table.
-  if(page_table_->Find(page_id,tar)){ //1.1 if exist
-    tar->pin_count_++;
-    replacer_->Erase(tar);
-    return tar;
+  while(true){
+    // 1. search hash table.
+    tar = FindPage(instance,lck,page_id);
+    if(tar != nullptr){ //1.1 if exist
+      instance.stats_.hits[Stats::FETCH]++;
+      PinFrame(instance,tar);
+      return tar;
+    }
+    // 1.2 if no exist
+    bool released = false;
+    if(strategy != nullptr){
+      tar = GetRingVictimPage(index,lck,strategy,released);
+    }else{
+      tar = GetVictimPage(instance,lck,released); //find from free_list_ first
+    }
+    if(tar == nullptr){ //no need to write back
+      instance.stats_.no_frame[Stats::FETCH]++;
+      return tar;
+    }
+    if(!released){
+      break;
+    }
+    // the latch was dropped, the page may have been loaded by another thread
+    Page *loaded = nullptr;
+    if(!instance.page_table_->Find(page_id,loaded)){
+      break;
+    }
+    instance.replacer_->Insert(FrameId(tar));
   }
-  // 1.2 if no exist
-  tar = GetVictimPage(); //find from free_list_ first
-  if(tar == nullptr) return tar; //no need to write back
-  // 2. If the entry chosen for replacement is dirty, write it back to disk
-  if(tar->is_dirty_){
-    disk_manager_->WritePage(tar->GetPageId(),tar->data_);
+  if(strategy != nullptr && GetFrame(tar).ring_ != strategy){
+    AddRingFrame(index,strategy,tar);
   }
-  // 3.delete old page
-  page_table_->Remove(tar->GetPageId());
-  page_table_->Insert(page_id,tar);
-  // 4.
-  disk_manager_->ReadPage(page_id,tar->data_);
-  tar->pin_count_ = 1;
-  tar->is_dirty_ = false;
-  tar->page_id_= page_id;
-
+  // 2.-4.
+  instance.stats_.misses[Stats::FETCH]++;
+  LoadFrame(instance,lck,tar,page_id,true);
   return tar;
 }
 
@@ -103,23 +708,162 @@ Page *BufferPoolManager::FetchPage(page_id_t page_id) {
  * dirty flag of this page
  */
 bool BufferPoolManager::UnpinPage(page_id_t page_id, bool is_dirty) {
-  lock_guard<mutex> lck(latch_);
+  BufferPoolInstance &instance = GetInstance(page_id);
+  unique_lock<mutex> lck(instance.latch_, std::defer_lock);
+  LatchInstance(instance, lck);
+  return UnpinFrame(instance,page_id,is_dirty);
+}
+
+/*
+ * UnpinPage with the latch of instance held
+ */
+bool BufferPoolManager::UnpinFrame(BufferPoolInstance &instance,
+                                   page_id_t page_id, bool is_dirty) {
   Page *tar = nullptr;
   // If there is no entry in the page table for the given page_id, then return false
-  page_table_->Find(page_id,tar);
-  if(tar == nullptr){
+  instance.page_table_->Find(page_id,tar);
+  // a frame being written back is still reachable by its old page id
+  if(tar == nullptr || tar->GetPageId() != page_id){
     return false;
   }
-  tar->is_dirty_=is_dirty;
+  // a clean unpin must not hide changes made under an earlier pin
+  if(is_dirty){
+    SetDirty(tar);
+  }
   if(tar->GetPinCount() <= 0 ){
     return false;
   }
   if(--tar->pin_count_ == 0){
-    replacer_->Insert(tar);
+    FrameHeader &frame = GetFrame(tar);
+    instance.stats_.pinned_frames--;
+    frame.last_unpin_ = ++instance.unpin_clock_;
+    // ring frames are recycled by their strategy only
+    if(frame.ring_ == nullptr){
+      RecordAccess(instance,tar);
+    }
   }
   return true;
 }
 
+/*
+ * positions in page_ids of the pages of every instance
+ */
+std::vector<std::vector<size_t>>
+BufferPoolManager::GroupByInstance(const std::vector<page_id_t> &page_ids) {
+  std::vector<std::vector<size_t>> groups(num_instances_);
+  for (size_t i = 0; i < page_ids.size(); ++i) {
+    groups[static_cast<size_t>(page_ids[i]) % num_instances_].push_back(i);
+  }
+  return groups;
+}
+
+/*
+ * Batched FetchPage: pages[i] is page_ids[i] pinned once, or nullptr when
+ * no frame was left for it or it is INVALID_PAGE_ID. Every instance latch is normally taken once.
+ * Hits are pinned right away; misses get a frame claimed as in LoadFrame
+ * and, once the instance's latch is released, their disk I/O is issued back
+ * to back in page id order. A page id listed twice is pinned twice.
+ */
+std::vector<Page *>
+BufferPoolManager::FetchPages(const std::vector<page_id_t> &page_ids) {
+  std::vector<Page *> pages(page_ids.size(), nullptr);
+  std::vector<std::vector<size_t>> groups = GroupByInstance(page_ids);
+  for (size_t index = 0; index < num_instances_; ++index) {
+    if (groups[index].empty()) continue;
+    BufferPoolInstance &instance = instances_[index];
+    // frames claimed by this call whose I/O is still to be done
+    std::vector<std::pair<page_id_t, Page *>> loads;
+    std::vector<page_id_t> old_page_ids;
+    unique_lock<mutex> lck(instance.latch_, std::defer_lock);
+    LatchInstance(instance, lck);
+    auto finish_loads = [&]() {
+      lck.unlock();
+      std::vector<size_t> order(loads.size());
+      for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+      std::sort(order.begin(), order.end(), [&loads](size_t a, size_t b) {
+        return loads[a].first < loads[b].first;
+      });
+      for (size_t i : order) {
+        ReadFrame(loads[i].second, old_page_ids[i], true);
+      }
+      LatchInstance(instance, lck);
+      for (size_t i = 0; i < loads.size(); ++i) {
+        FinishLoad(instance, loads[i].second, old_page_ids[i]);
+      }
+      loads.clear();
+      old_page_ids.clear();
+    };
+    for (size_t pos : groups[index]) {
+      page_id_t page_id = page_ids[pos];
+      if (page_id == INVALID_PAGE_ID) continue;
+      Page *tar = nullptr;
+      // FindPage would wait for our own claimed frames forever
+      for (auto &load : loads) {
+        if (load.first == page_id) tar = load.second;
+      }
+      if (tar != nullptr) {
+        instance.stats_.hits[Stats::FETCH_BATCH]++;
+        PinFrame(instance, tar);
+        pages[pos] = tar;
+        continue;
+      }
+      while (true) {
+        // nor wait for somebody else's while holding claimed frames, that
+        // thread may be waiting for one of ours
+        if (!loads.empty() && instance.page_table_->Find(page_id, tar) &&
+            GetFrame(tar).io_in_progress_) {
+          finish_loads();
+        }
+        tar = FindPage(instance, lck, page_id);
+        if (tar != nullptr) {
+          instance.stats_.hits[Stats::FETCH_BATCH]++;
+          PinFrame(instance, tar);
+          break;
+        }
+        bool released = false;
+        tar = GetVictimPage(instance, lck, released);
+        if (tar == nullptr) {
+          instance.stats_.no_frame[Stats::FETCH_BATCH]++;
+          break;
+        }
+        Page *loaded = nullptr;
+        if (!released || !instance.page_table_->Find(page_id, loaded)) {
+          instance.stats_.misses[Stats::FETCH_BATCH]++;
+          old_page_ids.push_back(ClaimFrame(instance, tar, page_id));
+          loads.emplace_back(page_id, tar);
+          break;
+        }
+        instance.replacer_->Insert(FrameId(tar));
+      }
+      pages[pos] = tar;
+    }
+    if (!loads.empty()) {
+      finish_loads();
+    }
+  }
+  return pages;
+}
+
+/*
+ * Batched UnpinPage, one latch acquisition per instance. Returns false if
+ * any of the pages could not be unpinned.
+ */
+bool BufferPoolManager::UnpinPages(const std::vector<page_id_t> &page_ids,
+                                   bool is_dirty) {
+  bool all = true;
+  std::vector<std::vector<size_t>> groups = GroupByInstance(page_ids);
+  for (size_t index = 0; index < num_instances_; ++index) {
+    if (groups[index].empty()) continue;
+    BufferPoolInstance &instance = instances_[index];
+    unique_lock<mutex> lck(instance.latch_, std::defer_lock);
+    LatchInstance(instance, lck);
+    for (size_t pos : groups[index]) {
+      all = UnpinFrame(instance, page_ids[pos], is_dirty) && all;
+    }
+  }
+  return all;
+}
+
 /*
  * Used to flush a particular page of the buffer pool to disk. Should call the
  * write_page method of the disk manager
@@ -127,21 +871,40 @@ bool BufferPoolManager::UnpinPage(page_id_t page_id, bool is_dirty) {
  * NOTE: make sure page_id != INVALID_PAGE_ID
  */
 bool BufferPoolManager::FlushPage(page_id_t page_id) {
-  lock_guard<mutex> lck(latch_);
-  Page *tar = nullptr;
-  page_table_->Find(page_id,tar);
+  BufferPoolInstance &instance = GetInstance(page_id);
+  unique_lock<mutex> lck(instance.latch_, std::defer_lock);
+  LatchInstance(instance, lck);
+  Page *tar = FindPage(instance,lck,page_id);
   // don't have page or page_id is invalid
   if(tar == nullptr || tar->page_id_ == INVALID_PAGE_ID){
     return false;
   }
-  // if(is_dirty) then write back 
+  // if(is_dirty) then write back
   if(tar->is_dirty_){
-    disk_manager_->WritePage(page_id,tar->GetData());
-    tar->is_dirty_ = false;
+    instance.stats_.foreground_writes++;
+    WriteBackFrame(instance,lck,tar);
   }
   return true;
 }
 
+/*
+ * Write a dirty page to disk with lck released. New pins on the frame are
+ * held off by io_in_progress_ instead, and the dirty flag is cleared before
+ * the write so that an unpin(is_dirty) racing with it is not lost.
+ * The frame stays where it is in the replacer. Returns with lck held.
+ */
+void BufferPoolManager::WriteBackFrame(BufferPoolInstance &instance,
+                                       unique_lock<mutex> &lck, Page *tar) {
+  FrameHeader &frame = GetFrame(tar);
+  frame.io_in_progress_ = true;
+  ClearDirty(tar);
+  lck.unlock();
+  disk_manager_->WritePage(tar->GetPageId(),tar->GetData());
+  LatchInstance(instance, lck);
+  frame.io_in_progress_ = false;
+  frame.io_done_.notify_all();
+}
+
 /**
  * User should call this method for deleting a page. This routine will call
  * disk manager to deallocate the page. First, if page is found within page
@@ -151,38 +914,469 @@ bool BufferPoolManager::FlushPage(page_id_t page_id) {
  * the page is found within page table, but pin_count != 0, return false
  */
 bool BufferPoolManager::DeletePage(page_id_t page_id) {
-  lock_guard<mutex> lck(latch_);
-  Page *tar = nullptr;
-  page_table_->Find(page_id,tar);
+  BufferPoolInstance &instance = GetInstance(page_id);
+  unique_lock<mutex> lck(instance.latch_, std::defer_lock);
+  LatchInstance(instance, lck);
+  Page *tar = FindPage(instance,lck,page_id);
   if(tar != nullptr){
     // page can be deleted only when pincount = 0
     if(tar->GetPinCount() > 0){
       return false;
     }
     // delete records
-    replacer_->Erase(tar);
-    page_table_->Remove(page_id);
-    tar->is_dirty_= false;
+    instance.replacer_->Erase(FrameId(tar));
+    instance.page_table_->Remove(page_id);
+    tar->page_id_ = INVALID_PAGE_ID;
+    ClearDirty(tar);
     tar->ResetMemory();
-    // reclaim
-    free_list_->push_back(tar);
+    // reclaim, a ring frame stays with its strategy
+    if(GetFrame(tar).ring_ == nullptr){
+      instance.free_list_->push_back(FrameId(tar));
+    }
   }
   disk_manager_->DeallocatePage(page_id);
   return true;
 }
 
 
-// void BufferPoolManager::FlushAllPages(){
-//   lock_guard<mutex> lck(latch_);
-//   Page *tar = nullptr;
-//   // for(size_t i = 0; i < pool_size_; i++) {
-//   //   disk_manager_->WritePage(page_table_[i]);
-//   // }
-//   for_each(page_id_t page_id_temp in page_table_.keys){
-//     page_table_.Find(page_id_temp,tar);
-//     disk_manager_.WritePage(page_id_temp,tar.GetData());
-//   }
-// }
+/*
+ * Queue page_ids for the read-ahead workers. The ids are sorted so that a
+ * batch goes to disk as one ascending sweep. Once the queue holds as many
+ * pages as the pool has frames, further hints are dropped.
+ */
+void BufferPoolManager::PrefetchPages(const std::vector<page_id_t> &page_ids) {
+  std::vector<page_id_t> sorted(page_ids);
+  std::sort(sorted.begin(), sorted.end());
+  {
+    lock_guard<mutex> lck(prefetch_latch_);
+    if (prefetchers_.empty()) {
+      for (size_t i = 0; i < PREFETCH_THREADS; ++i) {
+        prefetchers_.emplace_back(&BufferPoolManager::PrefetchLoop, this);
+      }
+    }
+    for (page_id_t page_id : sorted) {
+      if (prefetch_queue_.size() >= pool_size_) break;
+      if (page_id != INVALID_PAGE_ID) {
+        prefetch_queue_.push_back(page_id);
+      }
+    }
+  }
+  prefetch_cv_.notify_all();
+}
+
+void BufferPoolManager::PrefetchLoop() {
+  unique_lock<mutex> lck(prefetch_latch_);
+  while (true) {
+    while (!prefetch_stop_ && prefetch_queue_.empty()) {
+      prefetch_cv_.wait(lck);
+    }
+    if (prefetch_stop_) break;
+    page_id_t page_id = prefetch_queue_.front();
+    prefetch_queue_.pop_front();
+    lck.unlock();
+    PrefetchPage(page_id);
+    lck.lock();
+  }
+}
+
+/*
+ * Miss path of FetchPage without the pin: the page is loaded through
+ * LoadFrame (so concurrent fetchers of it wait on its frame) and then goes
+ * to the replacer like a page that was used once.
+ */
+void BufferPoolManager::PrefetchPage(page_id_t page_id) {
+  BufferPoolInstance &instance = GetInstance(page_id);
+  unique_lock<mutex> lck(instance.latch_, std::defer_lock);
+  LatchInstance(instance, lck);
+  Page *tar = nullptr;
+  if (instance.page_table_->Find(page_id, tar)) {
+    instance.stats_.hits[Stats::PREFETCH]++;
+    return;
+  }
+  bool released = false;
+  tar = GetVictimPage(instance, lck, released);
+  if (tar == nullptr) {
+    instance.stats_.no_frame[Stats::PREFETCH]++;
+    return;
+  }
+  Page *loaded = nullptr;
+  if (released && instance.page_table_->Find(page_id, loaded)) {
+    instance.stats_.hits[Stats::PREFETCH]++;
+    instance.replacer_->Insert(FrameId(tar));
+    return;
+  }
+  instance.stats_.misses[Stats::PREFETCH]++;
+  LoadFrame(instance, lck, tar, page_id, true);
+  if (--tar->pin_count_ == 0) {
+    instance.stats_.pinned_frames--;
+    GetFrame(tar).last_unpin_ = ++instance.unpin_clock_;
+    RecordAccess(instance, tar);
+  }
+}
+
+/*
+ * Warm restart, part one: write the ids of the resident pages to file_name,
+ * most recently used first. Pinned pages count as most recent; the others
+ * are ordered by when they were last unpinned, as a fraction of the unpin
+ * clock of their instance so that instances can be compared.
+ * File format: magic, count, then count page ids, all native endian.
+ */
+bool BufferPoolManager::SaveResidentPages(const std::string &file_name) {
+  std::vector<std::pair<double, page_id_t>> resident;
+  {
+    // keeps constructed_ stable
+    lock_guard<mutex> resize_lck(resize_latch_);
+    for (size_t index = 0; index < num_instances_; ++index) {
+      BufferPoolInstance &instance = instances_[index];
+      unique_lock<mutex> lck(instance.latch_, std::defer_lock);
+      LatchInstance(instance, lck);
+      double clock = static_cast<double>(std::max<uint64_t>(1, instance.unpin_clock_));
+      for (size_t i = index; i < constructed_; i += num_instances_) {
+        Page *page = &pages_[i];
+        if (page->GetPageId() == INVALID_PAGE_ID) continue;
+        double recency = page->GetPinCount() > 0 ? 2.0 : frames_[i].last_unpin_ / clock;
+        resident.emplace_back(-recency, page->GetPageId());
+      }
+    }
+  }
+  std::sort(resident.begin(), resident.end());
+
+  std::ofstream out(file_name, std::ios::binary | std::ios::trunc);
+  uint32_t header[2] = {RESIDENT_FILE_MAGIC, static_cast<uint32_t>(resident.size())};
+  out.write(reinterpret_cast<const char *>(header), sizeof(header));
+  for (auto &entry : resident) {
+    out.write(reinterpret_cast<const char *>(&entry.second), sizeof(page_id_t));
+  }
+  out.close();
+  return !out.fail();
+}
+
+/*
+ * Warm restart, part two: queue the hottest pages listed in file_name, as
+ * many as each instance has frames for, for the read-ahead workers. They
+ * load them in page id order while the caller goes on serving requests.
+ * Returns the number of pages queued, 0 if the file is missing or not ours.
+ */
+size_t BufferPoolManager::PreloadPages(const std::string &file_name) {
+  std::ifstream in(file_name, std::ios::binary);
+  uint32_t header[2] = {0, 0};
+  if (!in.read(reinterpret_cast<char *>(header), sizeof(header)) ||
+      header[0] != RESIDENT_FILE_MAGIC) {
+    return 0;
+  }
+  // a truncated or corrupted file must not get to size the buffer: the
+  // count has to match what is left of the file
+  std::streampos body = in.tellg();
+  in.seekg(0, std::ios::end);
+  std::streamoff left = in.tellg() - body;
+  in.seekg(body);
+  if (left < 0 ||
+      static_cast<uint64_t>(header[1]) * sizeof(page_id_t) > static_cast<uint64_t>(left)) {
+    return 0;
+  }
+  std::vector<page_id_t> saved(header[1]);
+  if (!saved.empty() && !in.read(reinterpret_cast<char *>(saved.data()),
+                                 saved.size() * sizeof(page_id_t))) {
+    return 0;
+  }
+  // a page can only go to its own instance, so share out per instance
+  std::vector<size_t> room(num_instances_);
+  for (size_t index = 0; index < num_instances_; ++index) {
+    unique_lock<mutex> lck(instances_[index].latch_, std::defer_lock);
+    LatchInstance(instances_[index], lck);
+    room[index] = instances_[index].num_frames_;
+  }
+  std::vector<page_id_t> page_ids;
+  for (page_id_t page_id : saved) {
+    size_t &left = room[static_cast<uint32_t>(page_id) % num_instances_];
+    if (page_id >= 0 && left > 0) {
+      left--;
+      page_ids.push_back(page_id);
+    }
+  }
+  PrefetchPages(page_ids);
+  return page_ids.size();
+}
+
+/*
+ * Checkpoint: write out every page that is dirty when the call starts.
+ * 1. take a snapshot of the dirty pages, one instance latch at a time
+ * 2. sort it by page_id and cut it into runs of consecutive page ids
+ * 3. num_workers threads pick runs off a shared counter and write them
+ * Only the pages of the run being written are held off from new pins, every
+ * other page and instance keeps serving FetchPage during the checkpoint.
+ */
+BufferPoolManager::FlushStats BufferPoolManager::FlushAllPages(size_t num_workers){
+  FlushStats stats;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+  std::vector<std::pair<page_id_t, Page *>> dirty;
+  std::vector<Page *> pages;
+  for (size_t index = 0; index < num_instances_; ++index) {
+    unique_lock<mutex> lck(instances_[index].latch_, std::defer_lock);
+    LatchInstance(instances_[index], lck);
+    pages.clear();
+    CollectDirty(index, pages);
+    for (Page *page : pages) {
+      dirty.emplace_back(page->GetPageId(), page);
+    }
+  }
+
+  std::sort(dirty.begin(), dirty.end());
+  std::vector<std::pair<size_t, size_t>> runs; // [begin, end) of dirty
+  for (size_t i = 0; i < dirty.size();) {
+    size_t j = i + 1;
+    while (j < dirty.size() && j - i < MAX_WRITE_RUN &&
+           dirty[j].first == dirty[j - 1].first + 1) {
+      j++;
+    }
+    runs.emplace_back(i, j);
+    i = j;
+  }
+
+  std::atomic<size_t> next_run(0);
+  std::atomic<size_t> written(0);
+  auto worker = [&]() {
+    for (size_t r = next_run++; r < runs.size(); r = next_run++) {
+      written += WriteRun(&dirty[runs[r].first], runs[r].second - runs[r].first);
+    }
+  };
+  std::vector<std::thread> workers;
+  for (size_t i = 1; i < std::min(num_workers, runs.size()); ++i) {
+    workers.emplace_back(worker);
+  }
+  worker();
+  for (std::thread &t : workers) {
+    t.join();
+  }
+
+  stats.pages_written = written;
+  stats.bytes_written = stats.pages_written * PAGE_SIZE;
+  stats.write_runs = runs.size();
+  stats.elapsed_ms = std::chrono::duration<double, std::milli>(
+      std::chrono::steady_clock::now() - start).count();
+  return stats;
+}
+
+/*
+ * Claim the pages of a run that are still dirty and still hold the page id
+ * seen in the snapshot, write them in ascending page_id order and release
+ * them. Claimed frames are marked io_in_progress_ just like WriteBackFrame.
+ * DiskManager only takes one page per call, so the run goes out as
+ * back-to-back sequential writes rather than one vectored write.
+ */
+size_t BufferPoolManager::WriteRun(const std::pair<page_id_t, Page *> *run,
+                                   size_t length) {
+  std::vector<std::pair<page_id_t, Page *>> claimed;
+  for (size_t i = 0; i < length; ++i) {
+    page_id_t page_id = run[i].first;
+    Page *page = run[i].second;
+    BufferPoolInstance &instance = GetInstance(page_id);
+    unique_lock<mutex> lck(instance.latch_, std::defer_lock);
+    LatchInstance(instance, lck);
+    FrameHeader &frame = GetFrame(page);
+    if (page->GetPageId() != page_id || !page->is_dirty_ ||
+        frame.io_in_progress_) {
+      continue;
+    }
+    frame.io_in_progress_ = true;
+    ClearDirty(page);
+    claimed.push_back(run[i]);
+  }
+  for (size_t i = 0; i < claimed.size(); ++i) {
+    disk_manager_->WritePage(claimed[i].first, claimed[i].second->GetData());
+  }
+  for (size_t i = 0; i < claimed.size(); ++i) {
+    BufferPoolInstance &instance = GetInstance(claimed[i].first);
+    unique_lock<mutex> lck(instance.latch_, std::defer_lock);
+    LatchInstance(instance, lck);
+    instance.stats_.checkpoint_writes++;
+    FrameHeader &frame = GetFrame(claimed[i].second);
+    frame.io_in_progress_ = false;
+    frame.io_done_.notify_all();
+  }
+  return claimed.size();
+}
+
+lsn_t BufferPoolManager::GetOldestDirtyLSN() {
+  lsn_t oldest = INVALID_LSN;
+  std::vector<Page *> pages;
+  for (size_t index = 0; index < num_instances_; ++index) {
+    unique_lock<mutex> lck(instances_[index].latch_, std::defer_lock);
+    LatchInstance(instances_[index], lck);
+    pages.clear();
+    CollectDirty(index, pages);
+    for (Page *page : pages) {
+      lsn_t lsn = GetFrame(page).first_dirty_lsn_;
+      if (lsn != INVALID_LSN && (oldest == INVALID_LSN || lsn < oldest)) {
+        oldest = lsn;
+      }
+    }
+  }
+  return oldest;
+}
+
+/*
+ * Sum of the counters of all instances, each read under its latch, so the
+ * snapshot is consistent per instance but not across instances.
+ */
+BufferPoolManager::Stats BufferPoolManager::GetStats() {
+  Stats total;
+  for (size_t index = 0; index < num_instances_; ++index) {
+    BufferPoolInstance &instance = instances_[index];
+    unique_lock<mutex> lck(instance.latch_, std::defer_lock);
+    LatchInstance(instance, lck);
+    const Stats &stats = instance.stats_;
+    for (size_t t = 0; t < Stats::NUM_CALL_TYPES; ++t) {
+      total.hits[t] += stats.hits[t];
+      total.misses[t] += stats.misses[t];
+      total.no_frame[t] += stats.no_frame[t];
+    }
+    total.evictions += stats.evictions;
+    total.free_list_victims += stats.free_list_victims;
+    total.replacer_victims += stats.replacer_victims;
+    total.ring_victims += stats.ring_victims;
+    total.foreground_writes += stats.foreground_writes;
+    total.background_writes += stats.background_writes;
+    total.checkpoint_writes += stats.checkpoint_writes;
+    total.pinned_frames += stats.pinned_frames;
+    total.pinned_high_water += stats.pinned_high_water;
+    for (size_t b = 0; b < Stats::LATCH_BUCKETS; ++b) {
+      total.latch_waits[b] += stats.latch_waits[b];
+    }
+  }
+  return total;
+}
+
+std::string BufferPoolManager::Stats::ToString() const {
+  static const char *call_names[NUM_CALL_TYPES] = {"fetch", "fetch batch",
+                                                   "prefetch", "new"};
+  std::ostringstream os;
+  for (size_t t = 0; t < NUM_CALL_TYPES; ++t) {
+    os << call_names[t] << ": hits " << hits[t] << " misses " << misses[t]
+       << " no frame " << no_frame[t] << "\n";
+  }
+  os << "victims: free list " << free_list_victims << " replacer "
+     << replacer_victims << " ring " << ring_victims << ", evictions "
+     << evictions << "\n";
+  os << "write-backs: foreground " << foreground_writes << " background "
+     << background_writes << " checkpoint " << checkpoint_writes << "\n";
+  os << "pinned frames: " << pinned_frames << " high water "
+     << pinned_high_water << "\n";
+  os << "latch waits: none " << latch_waits[0];
+  int64_t limit = 1;
+  for (size_t b = 1; b + 1 < LATCH_BUCKETS; ++b) {
+    limit *= 4;
+    os << ", <" << limit << "us " << latch_waits[b];
+  }
+  os << ", >=" << limit << "us " << latch_waits[LATCH_BUCKETS - 1] << "\n";
+  return os.str();
+}
+
+/*
+ * Start the background writer thread, or retune it if already running.
+ * pages_per_second: upper bound on background writes across all instances
+ * dirty_high: an instance whose dirty share rises above this gets cleaned
+ * dirty_low: cleaning of that instance stops once its dirty share is here
+ */
+void BufferPoolManager::StartBackgroundFlusher(size_t pages_per_second,
+                                               double dirty_high,
+                                               double dirty_low) {
+  lock_guard<mutex> lck(flusher_latch_);
+  flusher_rate_ = pages_per_second;
+  dirty_high_ = dirty_high;
+  dirty_low_ = std::min(dirty_low, dirty_high);
+  if (!flusher_.joinable()) {
+    flusher_stop_ = false;
+    flusher_ = std::thread(&BufferPoolManager::FlusherLoop, this);
+  }
+}
+
+void BufferPoolManager::StopBackgroundFlusher() {
+  {
+    lock_guard<mutex> lck(flusher_latch_);
+    flusher_stop_ = true;
+  }
+  flusher_cv_.notify_all();
+  if (flusher_.joinable()) {
+    flusher_.join();
+  }
+}
+
+/*
+ * Background writer main loop. Every FLUSHER_INTERVAL it earns
+ * flusher_rate_ * FLUSHER_INTERVAL worth of writes (capped at one second's
+ * worth) and spends them on the instances, starting after the one it
+ * stopped at last time so no instance is starved.
+ */
+void BufferPoolManager::FlusherLoop() {
+  double tokens = 0;
+  size_t next = 0;
+  unique_lock<mutex> lck(flusher_latch_);
+  while (!flusher_stop_) {
+    flusher_cv_.wait_for(lck, FLUSHER_INTERVAL);
+    if (flusher_stop_) break;
+    double rate = static_cast<double>(flusher_rate_);
+    double high = dirty_high_, low = dirty_low_;
+    tokens = std::min(rate, tokens + rate * FLUSHER_INTERVAL.count() / 1000.0);
+    lck.unlock();
+    for (size_t i = 0; i < num_instances_ && tokens >= 1; ++i) {
+      tokens -= CleanInstance(next, static_cast<size_t>(tokens), high, low);
+      next = (next + 1) % num_instances_;
+    }
+    lck.lock();
+  }
+}
+
+/*
+ * Once the dirty share of instance index goes over high, write out its
+ * unpinned dirty pages, least recently unpinned first, until the share is
+ * back at low or budget pages were written. Those are the frames the
+ * replacer will hand out next, so foreground misses find them clean.
+ */
+size_t BufferPoolManager::CleanInstance(size_t index, size_t budget,
+                                        double high, double low) {
+  BufferPoolInstance &instance = instances_[index];
+  unique_lock<mutex> lck(instance.latch_, std::defer_lock);
+  LatchInstance(instance, lck);
+  size_t frames = instance.num_frames_, dirty = instance.dirty_count_;
+  if (frames == 0) return 0;
+  double ratio = static_cast<double>(dirty) / frames;
+  if (ratio > high) {
+    instance.cleaning_ = true;
+  }
+  if (!instance.cleaning_ || ratio <= low) {
+    instance.cleaning_ = false;
+    return 0;
+  }
+  std::vector<Page *> pages;
+  CollectDirty(index, pages);
+  std::vector<std::pair<uint64_t, Page *>> candidates;
+  for (Page *page : pages) {
+    if (page->GetPinCount() == 0 && !GetFrame(page).io_in_progress_) {
+      candidates.emplace_back(GetFrame(page).last_unpin_, page);
+    }
+  }
+  size_t target = static_cast<size_t>(low * frames);
+  size_t todo = std::min(budget, dirty - target);
+  std::sort(candidates.begin(), candidates.end());
+  size_t written = 0;
+  for (size_t i = 0; i < candidates.size() && written < todo; ++i) {
+    Page *page = candidates[i].second;
+    // the latch was dropped during earlier writes, check again
+    if (!page->is_dirty_ || page->GetPinCount() > 0 ||
+        GetFrame(page).io_in_progress_) {
+      continue;
+    }
+    instance.stats_.background_writes++;
+    WriteBackFrame(instance, lck, page);
+    written++;
+  }
+  if (dirty - written <= target) {
+    instance.cleaning_ = false;
+  }
+  return written;
+}
 
 /**
  * User should call this method if needs to create a new page. This routine
@@ -193,27 +1387,58 @@ bool BufferPoolManager::DeletePage(page_id_t page_id) {
  * into page table. return nullptr if all the pages in pool are pinned
  */
 Page *BufferPoolManager::NewPage(page_id_t &page_id) {
-  lock_guard<mutex> lck(latch_);
+  // the page id decides which instance gets the page, so allocate it first.
+  // ids are handed out sequentially, so when the chosen instance is fully
+  // pinned the next id lands on the next instance; give each one a chance.
+  // DeallocatePage does not make an id available again, so one that found
+  // no frame is kept for a later call instead.
+  std::vector<page_id_t> unplaced;
   Page *tar = nullptr;
-  tar = GetVictimPage();
-  if (tar == nullptr) return tar;
-  // allocate page_id
-  page_id = disk_manager_->AllocatePage();
-  //write back
-  if (tar->is_dirty_) {
-    disk_manager_->WritePage(tar->GetPageId(),tar->data_);
-  }
-  //remove old record
-  page_table_->Remove(tar->GetPageId());
-  // insert new record
-  page_table_->Insert(page_id,tar);
-
-  tar->page_id_ = page_id;
-  tar->ResetMemory();
-  tar->is_dirty_ = false;
-  tar->pin_count_ = 1;
-
+  for (size_t attempt = 0; attempt < num_instances_; ++attempt) {
+    page_id_t new_page_id = TakePageId();
+    BufferPoolInstance &instance = GetInstance(new_page_id);
+    unique_lock<mutex> lck(instance.latch_, std::defer_lock);
+    LatchInstance(instance, lck);
+    bool released = false;
+    tar = GetVictimPage(instance, lck, released);
+    if (tar == nullptr) {
+      instance.stats_.no_frame[Stats::NEW]++;
+      unplaced.push_back(new_page_id);
+      continue;
+    }
+    instance.stats_.misses[Stats::NEW]++;
+    page_id = new_page_id;
+    // write back the victim, zero out memory and insert new record
+    LoadFrame(instance, lck, tar, page_id, false);
+    break;
+  }
+  if (!unplaced.empty()) {
+    lock_guard<mutex> lck(spare_latch_);
+    spare_page_ids_.insert(spare_page_ids_.end(), unplaced.begin(),
+                           unplaced.end());
+    // smallest id at the back, taken first
+    std::sort(spare_page_ids_.begin(), spare_page_ids_.end(),
+              std::greater<page_id_t>());
+    spare_count_ = spare_page_ids_.size();
+  }
   return tar;
 }
 
+/*
+ * A page id kept by NewPage if there is one, a new one otherwise. The
+ * counter spares NewPage the latch while there is none, the usual case.
+ */
+page_id_t BufferPoolManager::TakePageId() {
+  if (spare_count_.load() > 0) {
+    lock_guard<mutex> lck(spare_latch_);
+    if (!spare_page_ids_.empty()) {
+      page_id_t page_id = spare_page_ids_.back();
+      spare_page_ids_.pop_back();
+      spare_count_ = spare_page_ids_.size();
+      return page_id;
+    }
+  }
+  return disk_manager_->AllocatePage();
+}
+
 } // namespace scudb
@@ -4,48 +4,295 @@
  * Functionality: The simplified Buffer Manager interface allows a client to
  * new/delete pages on disk, to read a disk page into the buffer pool and pin
  * it, also to unpin a page in the buffer pool.
+ *
+ * The pool is partitioned into num_instances independent instances. Each
+ * instance owns every num_instances-th frame together with its own page
+ * table, replacer, free list and latch, and a page is always served by
+ * instance page_id % num_instances. Requests for pages living in different
+ * instances therefore never contend on the same latch.
  */
 
 #pragma once
-#include <list>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
 #include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 
+#include "buffer/arc_replacer.h"
+#include "buffer/clock_replacer.h"
+#include "buffer/frame_id.h"
+#include "buffer/lru_k_replacer.h"
 #include "buffer/lru_replacer.h"
+#include "buffer/tiny_lfu_replacer.h"
 #include "disk/disk_manager.h"
-#include "hash/extendible_hash.h"
+#include "hash/page_table.h"
 #include "logging/log_manager.h"
 #include "page/page.h"
 
 
 namespace scudb {
+class BufferPoolManager;
+
+// page replacement policy of every instance of a BufferPoolManager
+enum class ReplacerPolicy { LRU = 0, CLOCK, LRU_K, ARC, TINY_LFU };
+
+/*
+ * Access strategy for large scans. Pages that a FetchPage under the strategy
+ * has to read from disk are loaded into a small private ring of frames
+ * (ring_size frames spread over the instances) that is reused round-robin,
+ * instead of evicting pages from the main replacer. Ring frames never enter
+ * the replacer; they go back to the pool when the strategy is destroyed.
+ * Pages that are already resident are fetched as usual.
+ * A strategy belongs to one scan and must outlive the pages it fetched.
+ */
+class BufferAccessStrategy {
+public:
+  BufferAccessStrategy(BufferPoolManager *buffer_pool_manager,
+                       size_t ring_size = 16);
+  ~BufferAccessStrategy();
+
+private:
+  friend class BufferPoolManager;
+  BufferAccessStrategy(const BufferAccessStrategy &) = delete;
+  BufferAccessStrategy &operator=(const BufferAccessStrategy &) = delete;
+
+  BufferPoolManager *buffer_pool_manager_;
+  size_t ring_size_;  // frames per instance
+  // ring of each instance and its next slot to reuse, instance latch held
+  std::vector<std::vector<Page *>> rings_;
+  std::vector<size_t> hands_;
+};
+
 class BufferPoolManager {
 public:
+  // what one FlushAllPages checkpoint did
+  struct FlushStats {
+    size_t pages_written = 0;
+    size_t bytes_written = 0;
+    size_t write_runs = 0;  // groups of consecutive page ids written together
+    double elapsed_ms = 0;
+  };
+
+  // counters kept by every instance under its latch; GetStats() adds them up
+  struct Stats {
+    enum CallType { FETCH = 0, FETCH_BATCH, PREFETCH, NEW, NUM_CALL_TYPES };
+    // latch_waits[0] counts acquisitions that did not wait, latch_waits[b]
+    // waits shorter than 4^b microseconds, the last bucket all longer ones
+    static const size_t LATCH_BUCKETS = 8;
+
+    uint64_t hits[NUM_CALL_TYPES] = {};     // page already in the pool
+    uint64_t misses[NUM_CALL_TYPES] = {};   // page needed a frame
+    uint64_t no_frame[NUM_CALL_TYPES] = {}; // all frames were pinned
+    uint64_t evictions = 0;                 // victims that held a page
+    uint64_t free_list_victims = 0;
+    uint64_t replacer_victims = 0;
+    uint64_t ring_victims = 0;              // reused by a strategy's ring
+    uint64_t foreground_writes = 0;         // dirty victims and FlushPage
+    uint64_t background_writes = 0;         // background writer
+    uint64_t checkpoint_writes = 0;         // FlushAllPages
+    size_t pinned_frames = 0;
+    // highest pinned_frames seen; summed over instances in a snapshot, so
+    // an upper bound for the pool when it has several instances
+    size_t pinned_high_water = 0;
+    uint64_t latch_waits[LATCH_BUCKETS] = {};
+
+    std::string ToString() const;
+  };
+
   BufferPoolManager(size_t pool_size, DiskManager *disk_manager,
-                          LogManager *log_manager = nullptr);
+                          LogManager *log_manager = nullptr,
+                          size_t num_instances = 1,
+                          size_t max_pool_size = 0,
+                          ReplacerPolicy policy = ReplacerPolicy::LRU);
 
   ~BufferPoolManager();
 
-  Page *FetchPage(page_id_t page_id);
+  // a miss under strategy is loaded into the strategy's ring, see above
+  Page *FetchPage(page_id_t page_id, BufferAccessStrategy *strategy = nullptr);
 
   bool UnpinPage(page_id_t page_id, bool is_dirty);
 
+  // batched FetchPage/UnpinPage taking every instance latch only once;
+  // FetchPages returns the pages in the order of page_ids, nullptr for
+  // the ones that found no free frame
+  std::vector<Page *> FetchPages(const std::vector<page_id_t> &page_ids);
+  bool UnpinPages(const std::vector<page_id_t> &page_ids, bool is_dirty);
+
   bool FlushPage(page_id_t page_id);
 
   Page *NewPage(page_id_t &page_id);
 
   bool DeletePage(page_id_t page_id);
 
-  void FlushAllPages();
+  // read-ahead hint: load the pages into the pool in the background without
+  // pinning them; requests beyond what the pool can hold are dropped
+  void PrefetchPages(const std::vector<page_id_t> &page_ids);
+
+  // warm restart: save the ids of the resident pages, hottest first, and
+  // have a later pool load them back in the background
+  bool SaveResidentPages(const std::string &file_name);
+  size_t PreloadPages(const std::string &file_name);
+
+  // checkpoint: write every page that is dirty when the call starts
+  FlushStats FlushAllPages(size_t num_workers = 4);
+
+  // background writer: keep the dirty share of every instance between
+  // dirty_low and dirty_high (fractions of its frames) by writing out the
+  // least recently unpinned dirty pages, at most pages_per_second of them
+  void StartBackgroundFlusher(size_t pages_per_second, double dirty_high = 0.3,
+                              double dirty_low = 0.1);
+  void StopBackgroundFlusher();
+
+  // smallest LSN a currently dirty page had before it was first dirtied,
+  // INVALID_LSN if no page is dirty; redo must not start after this
+  lsn_t GetOldestDirtyLSN();
+
+  Stats GetStats();
+
+  // grow or shrink the pool online, returns the size reached
+  size_t Resize(size_t new_size);
+
+  size_t GetPoolSize() const { return pool_size_; }
+  size_t GetNumInstances() const { return num_instances_; }
 
 private:
-  size_t pool_size_; // number of pages in buffer pool
-  Page *pages_;      // array of pages
+  friend class BufferAccessStrategy;
+
+  // one partition of the pool, everything in it is protected by its latch_
+  struct BufferPoolInstance {
+    PageTable *page_table_; // to keep track of pages
+    // to find an unpinned frame for replacement
+    Replacer<frame_id_t> *replacer_;
+    std::deque<frame_id_t> *free_list_; // to find a free frame for replacement
+    std::mutex latch_;             // to protect shared data structure
+    uint64_t unpin_clock_ = 0;     // ticks on every unpin to zero
+    bool cleaning_ = false;        // background writer passed dirty_high
+    size_t num_frames_ = 0;        // frames of this instance in service
+    // frames pinned from or unpinned to zero that replacer_ has not been
+    // told about yet, see RecordAccess
+    std::vector<frame_id_t> access_buffer_;
+    std::vector<Page *> retired_;  // frames of this instance out of service
+    // dirty page table, sized for the largest pool: bit i is set when the
+    // instance's i-th frame (pages_[index + i * num_instances_]) is dirty
+    std::vector<uint64_t> dirty_bitmap_;
+    size_t dirty_count_ = 0;
+    Stats stats_;
+  };
+
+  // per-frame state kept beside the Page, frames_[i] describes pages_[i]
+  struct FrameHeader {
+    // a disk read or write on this frame is running without the latch
+    bool io_in_progress_ = false;
+    // signalled (under the instance latch) when io_in_progress_ clears
+    std::condition_variable io_done_;
+    // unpin_clock_ of the instance when the pin count last dropped to zero
+    uint64_t last_unpin_ = 0;
+    // page LSN when the pin count last went up from zero; every change
+    // made under that pin gets a larger LSN
+    lsn_t pin_lsn_ = INVALID_LSN;
+    // pin_lsn_ of the pin under which the page went from clean to dirty
+    lsn_t first_dirty_lsn_ = INVALID_LSN;
+    // set while the frame belongs to the ring of a strategy, such a frame
+    // is kept out of the replacer and the free list
+    BufferAccessStrategy *ring_ = nullptr;
+    // the frame is in the access buffer of its instance
+    bool buffered_ = false;
+  };
+
+  // return the instance that is responsible for page_id
+  BufferPoolInstance &GetInstance(page_id_t page_id);
+  FrameHeader &GetFrame(Page *page);
+  // frame id of page within its instance and back
+  frame_id_t FrameId(Page *page) const;
+  Page *FramePage(BufferPoolInstance &instance, frame_id_t frame_id) const;
+  // lock lck on the instance latch, recording the wait in its stats
+  void LatchInstance(BufferPoolInstance &instance, std::unique_lock<std::mutex> &lck);
+  void PinFrame(BufferPoolInstance &instance, Page *tar);
+  // hand pinned and unpinned frames to the replacer in batches, instance
+  // latch held
+  void RecordAccess(BufferPoolInstance &instance, Page *page);
+  void DrainAccesses(BufferPoolInstance &instance);
+  // keep is_dirty_ and the dirty page table in sync, instance latch held
+  void SetDirty(Page *page);
+  void ClearDirty(Page *page);
+  // append the dirty frames of instance index, latch held
+  void CollectDirty(size_t index, std::vector<Page *> &dirty);
+  // look up a page, waiting out disk I/O on its frame
+  Page *FindPage(BufferPoolInstance &instance, std::unique_lock<std::mutex> &lck,
+                 page_id_t page_id);
+  // return a page pointer that to be victim
+  Page *GetVictimPage(BufferPoolInstance &instance,
+                      std::unique_lock<std::mutex> &lck, bool &released);
+  // page id for NewPage, see spare_page_ids_
+  page_id_t TakePageId();
+  // choose a victim frame from the ring of strategy for instance index
+  Page *GetRingVictimPage(size_t index, std::unique_lock<std::mutex> &lck,
+                          BufferAccessStrategy *strategy, bool &released);
+  // put a frame taken from the pool into the ring, instance latch held
+  void AddRingFrame(size_t index, BufferAccessStrategy *strategy, Page *page);
+  // hand a ring frame back to the pool, instance latch held
+  void ReleaseRingFrame(BufferPoolInstance &instance, Page *page);
+  // write back the victim and read page_id into it without holding the latch
+  void LoadFrame(BufferPoolInstance &instance, std::unique_lock<std::mutex> &lck,
+                 Page *tar, page_id_t page_id, bool read_page);
+  // the steps of LoadFrame: claim under the latch, I/O, finish under it
+  page_id_t ClaimFrame(BufferPoolInstance &instance, Page *tar, page_id_t page_id);
+  void ReadFrame(Page *tar, page_id_t old_page_id, bool read_page);
+  void FinishLoad(BufferPoolInstance &instance, Page *tar, page_id_t old_page_id);
+  // unpin with the instance latch held
+  bool UnpinFrame(BufferPoolInstance &instance, page_id_t page_id, bool is_dirty);
+  std::vector<std::vector<size_t>>
+  GroupByInstance(const std::vector<page_id_t> &page_ids);
+  // write a dirty page out without holding the latch
+  void WriteBackFrame(BufferPoolInstance &instance,
+                      std::unique_lock<std::mutex> &lck, Page *tar);
+  // write a run of pages with consecutive ids, returns pages written
+  size_t WriteRun(const std::pair<page_id_t, Page *> *run, size_t length);
+  void FlusherLoop();
+  // take one frame out of service for Resize
+  bool RetireFrame(BufferPoolInstance &instance, std::unique_lock<std::mutex> &lck);
+  // one background writer pass over an instance, returns pages written
+  size_t CleanInstance(size_t index, size_t budget, double high, double low);
+  void PrefetchLoop();
+  // load page_id unless it is already in the pool, leaving it unpinned
+  void PrefetchPage(page_id_t page_id);
+
+  std::atomic<size_t> pool_size_; // number of pages in buffer pool
+  size_t num_instances_; // number of independent partitions
+  size_t capacity_;      // frames reserved in the arena, see Resize
+  size_t constructed_;   // frames constructed so far, only Resize adds
+  ReplacerPolicy policy_; // replacer of every instance
+  std::mutex resize_latch_; // serializes Resize
+  Page *pages_;          // array of pages, placed in an mmap'ed arena
+  size_t arena_length_;  // bytes mapped for pages_
+  FrameHeader *frames_;  // array of capacity_ frame headers
   DiskManager *disk_manager_;
   LogManager *log_manager_;
-  HashTable<page_id_t, Page *> *page_table_; // to keep track of pages
-  Replacer<Page *> *replacer_;   // to find an unpinned page for replacement
-  std::list<Page *> *free_list_; // to find a free page for replacement
-  std::mutex latch_;             // to protect shared data structure
-  Page *GetVictimPage();         // return a page pointer that to be victim
+  BufferPoolInstance *instances_; // array of num_instances_ partitions
+  // ids NewPage allocated but found no frame for, handed out again before
+  // new ones are allocated; smallest last
+  std::mutex spare_latch_; // protects spare_page_ids_
+  std::vector<page_id_t> spare_page_ids_;
+  std::atomic<size_t> spare_count_{0}; // spare_page_ids_.size()
+
+  // background writer
+  std::thread flusher_;
+  std::mutex flusher_latch_; // protects the fields below
+  std::condition_variable flusher_cv_;
+  bool flusher_stop_ = false;
+  size_t flusher_rate_ = 0;  // pages per second
+  double dirty_high_ = 0;
+  double dirty_low_ = 0;
+
+  // read-ahead workers, started by the first PrefetchPages call
+  std::vector<std::thread> prefetchers_;
+  std::mutex prefetch_latch_; // protects the fields below
+  std::condition_variable prefetch_cv_;
+  std::deque<page_id_t> prefetch_queue_;
+  bool prefetch_stop_ = false;
 };
 } // namespace scudb
@@ -0,0 +1,83 @@
+/**
+ * CLOCK implementation
+ */
+#include "buffer/clock_replacer.h"
+#include "buffer/frame_id.h"
+#include "page/page.h"
+
+namespace scudb {
+
+template <typename T> ClockReplacer<T>::ClockReplacer() : hand(0), size(0) {}
+
+template <typename T> ClockReplacer<T>::~ClockReplacer() {}
+
+/*
+ * Make value evictable and give it a second chance
+ */
+template <typename T> void ClockReplacer<T>::Insert(const T &value) {
+  std::lock_guard<std::mutex> lck(latch);
+  size_t slot;
+  if(!slots.Find(value, slot)){
+    slot = values.size();
+    slots.Add(value, slot);
+    values.push_back(value);
+    evictable.push_back(0);
+    referenced.push_back(0);
+  }
+  if(!evictable[slot]){
+    evictable[slot] = 1;
+    size++;
+  }
+  referenced[slot] = 1;
+}
+
+/*
+ * Advance the hand to the first evictable value without reference bit,
+ * clearing the bits passed on the way. Two rounds at most.
+ */
+template <typename T> bool ClockReplacer<T>::Victim(T &value) {
+  std::lock_guard<std::mutex> lck(latch);
+  if(size == 0){
+    return false;
+  }
+  while(true){
+    size_t slot = hand;
+    hand = (hand + 1) % values.size();
+    if(!evictable[slot]){
+      continue;
+    }
+    if(referenced[slot]){
+      referenced[slot] = 0;
+      continue;
+    }
+    evictable[slot] = 0;
+    size--;
+    value = values[slot];
+    return true;
+  }
+}
+
+/*
+ * Remove value from the candidates, true if it was one
+ */
+template <typename T> bool ClockReplacer<T>::Erase(const T &value) {
+  std::lock_guard<std::mutex> lck(latch);
+  size_t slot;
+  if(!slots.Find(value, slot) || !evictable[slot]){
+    return false;
+  }
+  evictable[slot] = 0;
+  size--;
+  return true;
+}
+
+template <typename T> size_t ClockReplacer<T>::Size() {
+  std::lock_guard<std::mutex> lck(latch);
+  return size;
+}
+
+template class ClockReplacer<Page *>;
+// frame ids of the buffer pool, also what the tests use
+template class ClockReplacer<frame_id_t>;
+
+} // namespace scudb
@@ -0,0 +1,48 @@
+/**
+ * clock_replacer.h
+ *
+ * Functionality: CLOCK (second chance) approximation of LRU. Every value has
+ * a slot in flat arrays holding whether it is evictable and its reference
+ * bit. Insert and Erase only flip the flags of the slot; Victim sweeps a hand
+ * over the slots, clearing reference bits, until it meets an evictable slot
+ * whose bit is already clear.
+ */
+
+#pragma once
+
+#include <mutex>
+#include <vector>
+#include "buffer/replacer.h"
+#include "buffer/slot_map.h"
+
+using namespace std;
+namespace scudb {
+
+template <typename T> class ClockReplacer : public Replacer<T> {
+public:
+
+  ClockReplacer();
+
+  ~ClockReplacer();
+
+  void Insert(const T &value);
+
+  bool Victim(T &value);
+
+  bool Erase(const T &value);
+
+  size_t Size();
+
+private:
+  // slots are handed out on first sight and never given back, the values
+  // are the frames of the pool
+  SlotMap<T> slots;                     // value -> its slot
+  std::vector<T> values;                // slot -> value
+  std::vector<char> evictable;
+  std::vector<char> referenced;
+  size_t hand;
+  size_t size;
+  mutable std::mutex latch;
+};
+
+} // namespace scudb
@@ -0,0 +1,71 @@
+#include "hash/count_min_sketch.h"
+
+namespace scudb {
+
+// one multiplier per row, odd 64-bit constants
+static const uint64_t ROW_SEEDS[] = {0x9E3779B97F4A7C15ULL, 0xC2B2AE3D27D4EB4FULL,
+                                     0x165667B19E3779F9ULL, 0xD6E8FEB86659FD93ULL};
+
+CountMinSketch::CountMinSketch(size_t counters, size_t sample_size)
+    : mask(0) {
+  Resize(counters, sample_size);
+}
+
+void CountMinSketch::Resize(size_t counters, size_t sample_size) {
+  sampleSize = sample_size == 0 ? 1 : sample_size;
+  size_t width = 16;
+  while (width < counters) {
+    width <<= 1;
+  }
+  if (table.empty() || width != mask + 1) {
+    mask = width - 1;
+    table.assign(DEPTH * width / 2, 0);
+    additions = 0;
+  }
+}
+
+size_t CountMinSketch::Index(uint64_t key, size_t row) const {
+  uint64_t h = (key + row) * ROW_SEEDS[row];
+  h ^= h >> 32;
+  return row * (mask + 1) + (h & mask);
+}
+
+uint8_t CountMinSketch::Get(size_t i) const {
+  return (table[i >> 1] >> ((i & 1) * 4)) & 0x0F;
+}
+
+void CountMinSketch::Add(size_t i) {
+  if (Get(i) < MAX_COUNT) {
+    table[i >> 1] += static_cast<uint8_t>(1 << ((i & 1) * 4));
+  }
+}
+
+void CountMinSketch::Increment(uint64_t key) {
+  for (size_t row = 0; row < DEPTH; ++row) {
+    Add(Index(key, row));
+  }
+  if (++additions >= sampleSize) {
+    Age();
+  }
+}
+
+uint8_t CountMinSketch::Estimate(uint64_t key) const {
+  uint8_t estimate = MAX_COUNT;
+  for (size_t row = 0; row < DEPTH; ++row) {
+    uint8_t counter = Get(Index(key, row));
+    if (counter < estimate) {
+      estimate = counter;
+    }
+  }
+  return estimate;
+}
+
+void CountMinSketch::Age() {
+  // halve both nibbles, dropping the bit the high one shifts into the low
+  for (uint8_t &pair : table) {
+    pair = (pair >> 1) & 0x77;
+  }
+  additions /= 2;
+}
+
+} // namespace scudb
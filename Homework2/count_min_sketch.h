@@ -0,0 +1,49 @@
+/*
+ * count_min_sketch.h : approximate access counter for admission decisions
+ *
+ * Functionality: estimates how often a key was seen recently in a fixed
+ * amount of memory. Each of DEPTH rows maps a key to one 4-bit counter; the
+ * estimate is the smallest of the key's counters, which can only be too high
+ * (when other keys share all its counters), never too low. After
+ * sample_size increments every counter is halved, so the counts follow the
+ * recent workload rather than all of history.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+namespace scudb {
+
+class CountMinSketch {
+public:
+  // counters: counters per row, rounded up to a power of two
+  explicit CountMinSketch(size_t counters, size_t sample_size);
+
+  // as the constructor; the counts survive unless the row width changes
+  void Resize(size_t counters, size_t sample_size);
+
+  void Increment(uint64_t key);
+
+  // never below the number of increments of key since the last aging
+  uint8_t Estimate(uint64_t key) const;
+
+private:
+  static const size_t DEPTH = 4;
+  static const uint8_t MAX_COUNT = 15;
+
+  // counter number i of the table, two per byte, low nibble first
+  size_t Index(uint64_t key, size_t row) const;
+  uint8_t Get(size_t i) const;
+  void Add(size_t i);
+  void Age();
+
+  size_t mask;                 // counters per row - 1
+  size_t sampleSize;
+  size_t additions;            // increments since the last aging
+  std::vector<uint8_t> table;  // DEPTH rows of mask + 1 4-bit counters
+};
+
+} // namespace scudb
@@ -0,0 +1,69 @@
+#include "hash/epoch_manager.h"
+
+namespace scudb {
+
+thread_local EpochManager::Record *EpochManager::localRecord = nullptr;
+
+EpochManager::RecordOwner::~RecordOwner() {
+  if (record != nullptr) {
+    localRecord = nullptr;
+    record->inUse.store(false, std::memory_order_release);
+  }
+}
+
+/*
+ * The calling thread's record: one given back by an exited thread if there
+ * is one, a new one otherwise.
+ */
+EpochManager::Record *EpochManager::AcquireRecord() {
+  static thread_local RecordOwner owner;
+  for (Record *r = records.load(std::memory_order_acquire); r != nullptr;
+       r = r->next) {
+    bool free = false;
+    if (!r->inUse.load(std::memory_order_relaxed) &&
+        r->inUse.compare_exchange_strong(free, true)) {
+      owner.record = localRecord = r;
+      return r;
+    }
+  }
+  Record *r = new Record;
+  r->state.store(0, std::memory_order_relaxed);
+  r->inUse.store(true, std::memory_order_relaxed);
+  r->depth = 0;
+  r->next = records.load(std::memory_order_relaxed);
+  while (!records.compare_exchange_weak(r->next, r)) {
+  }
+  owner.record = localRecord = r;
+  return r;
+}
+
+uint64_t EpochManager::RetireEpoch() const {
+  return epoch.load(std::memory_order_seq_cst);
+}
+
+/*
+ * Move the global epoch on by one if every active reader has announced the
+ * current one.
+ */
+bool EpochManager::TryAdvance() {
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  uint64_t current = epoch.load(std::memory_order_seq_cst);
+  for (Record *r = records.load(std::memory_order_acquire); r != nullptr;
+       r = r->next) {
+    uint64_t state = r->state.load(std::memory_order_seq_cst);
+    if ((state & 1) != 0 && (state >> 1) != current) {
+      return false;
+    }
+  }
+  return epoch.compare_exchange_strong(current, current + 1);
+}
+
+bool EpochManager::CanFree(uint64_t retired) {
+  if (epoch.load(std::memory_order_acquire) >= retired + 2) {
+    return true;
+  }
+  TryAdvance();
+  return epoch.load(std::memory_order_acquire) >= retired + 2;
+}
+
+} // namespace scudb
@@ -0,0 +1,95 @@
+/*
+ * epoch_manager.h : epoch based reclamation for latch-free readers
+ *
+ * Functionality: lets a structure free memory that threads reading it without
+ * a latch may still be looking at. Readers run inside an EpochGuard. A writer
+ * that has unlinked an object notes RetireEpoch() and frees the object once
+ * CanFree says that every reader that could have reached it has left.
+ *
+ * Every thread announces the global epoch it entered at in a record of its
+ * own, so entering and leaving write only to that thread's cache line. The
+ * global epoch only moves on when all active readers have seen it; an object
+ * retired at epoch e is unreachable once the epoch is e + 2.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+
+namespace scudb {
+
+class EpochManager {
+public:
+  // the manager shared by all tables of the process
+  static EpochManager &Instance() {
+    static EpochManager manager;
+    return manager;
+  }
+
+  // reader side, nests; use EpochGuard. The exchange orders the
+  // announcement before every load the reader makes inside the guard, so a
+  // writer that sees no announcement knows the reader will only find what
+  // is still linked.
+  void Enter() {
+    Record *r = LocalRecord();
+    if (r->depth++ == 0) {
+      r->state.exchange((epoch.load(std::memory_order_relaxed) << 1) | 1,
+                        std::memory_order_seq_cst);
+    }
+  }
+  void Exit() {
+    Record *r = LocalRecord();
+    if (--r->depth == 0) {
+      r->state.store(0, std::memory_order_release);
+    }
+  }
+
+  // epoch to tag an object with once it is unlinked
+  uint64_t RetireEpoch() const;
+  // whether an object tagged with epoch can be freed, trying to move the
+  // global epoch on if not
+  bool CanFree(uint64_t epoch);
+
+private:
+  struct Record {
+    // (announced epoch << 1) | 1 while the thread is inside a guard, 0 outside
+    std::atomic<uint64_t> state;
+    std::atomic<bool> inUse;   // owned by a live thread
+    size_t depth;              // guards open on the owning thread
+    Record *next;              // records are never freed, only reused
+    char padding[64];          // keep other records off this cache line
+  };
+  // owner of the calling thread's record, gives it back at thread exit
+  struct RecordOwner {
+    Record *record = nullptr;
+    ~RecordOwner();
+  };
+
+  EpochManager() : epoch(2), records(nullptr) {}
+  Record *LocalRecord() {
+    return localRecord != nullptr ? localRecord : AcquireRecord();
+  }
+  Record *AcquireRecord();
+  bool TryAdvance();
+
+  // the calling thread's record, kept apart from RecordOwner so that the
+  // fast path reads a plain thread_local
+  static thread_local Record *localRecord;
+
+  std::atomic<uint64_t> epoch;
+  std::atomic<Record *> records;
+};
+
+class EpochGuard {
+public:
+  EpochGuard() { EpochManager::Instance().Enter(); }
+  ~EpochGuard() { EpochManager::Instance().Exit(); }
+
+private:
+  EpochGuard(const EpochGuard &) = delete;
+  EpochGuard &operator=(const EpochGuard &) = delete;
+};
+
+} // namespace scudb
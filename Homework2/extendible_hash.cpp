@@ -1,4 +1,14 @@
+#include <algorithm>
+#include <cstring>
 #include <list>
+#include <new>
+#include <unordered_set>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 #include "hash/extendible_hash.h"
 #include "page/page.h"
@@ -6,34 +16,218 @@ using namespace std;
 
 namespace scudb {
 
+// tags compared by one MatchTags call
+#if defined(__AVX2__)
+static const size_t TAG_GROUP = 32;
+#else
+static const size_t TAG_GROUP = 16;
+#endif
+
+/*
+ * bit i of the result is set when tags[i] == tag, for the TAG_GROUP tags
+ * starting at tags
+ */
+static inline uint32_t MatchTags(const uint8_t *tags, uint8_t tag) {
+#if defined(__AVX2__)
+  __m256i group = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(tags));
+  __m256i equal = _mm256_cmpeq_epi8(group, _mm256_set1_epi8(static_cast<char>(tag)));
+  return static_cast<uint32_t>(_mm256_movemask_epi8(equal));
+#elif defined(__SSE2__)
+  __m128i group = _mm_loadu_si128(reinterpret_cast<const __m128i *>(tags));
+  __m128i equal = _mm_cmpeq_epi8(group, _mm_set1_epi8(static_cast<char>(tag)));
+  return static_cast<uint32_t>(_mm_movemask_epi8(equal));
+#else
+  uint32_t match = 0;
+  for (size_t i = 0; i < TAG_GROUP; i++) {
+    match |= static_cast<uint32_t>(tags[i] == tag) << i;
+  }
+  return match;
+#endif
+}
+
+static const size_t CACHE_LINE = 64;
+
+static inline size_t RoundUp(size_t n, size_t alignment) {
+  return (n + alignment - 1) / alignment * alignment;
+}
+
+template <typename K, typename V, typename Hash>
+ExtendibleHash<K, V, Hash>::Bucket::Bucket(int depth, size_t capacity)
+    : version(0), localDepth(depth), count(0), capacity(capacity),
+      tags(nullptr), keys(nullptr), values(nullptr) {}
+
+template <typename K, typename V, typename Hash>
+size_t ExtendibleHash<K, V, Hash>::Bucket::Layout(size_t capacity,
+                                                  size_t &tags_at,
+                                                  size_t &keys_at,
+                                                  size_t &values_at) {
+  tags_at = RoundUp(sizeof(Bucket), CACHE_LINE);
+  keys_at = RoundUp(tags_at + RoundUp(capacity, TAG_GROUP), alignof(K));
+  values_at = RoundUp(keys_at + capacity * sizeof(K), alignof(V));
+  return values_at + capacity * sizeof(V);
+}
+
+template <typename K, typename V, typename Hash>
+typename ExtendibleHash<K, V, Hash>::Bucket *
+ExtendibleHash<K, V, Hash>::Bucket::Create(int depth, size_t capacity) {
+  size_t tags_at, keys_at, values_at;
+  size_t bytes = Layout(capacity, tags_at, keys_at, values_at);
+  void *block = nullptr;
+  if (posix_memalign(&block, CACHE_LINE, bytes) != 0) {
+    throw std::bad_alloc();
+  }
+  char *base = static_cast<char *>(block);
+  Bucket *bucket = new (block) Bucket(depth, capacity);
+  bucket->tags = reinterpret_cast<uint8_t *>(base + tags_at);
+  bucket->keys = reinterpret_cast<K *>(base + keys_at);
+  bucket->values = reinterpret_cast<V *>(base + values_at);
+  memset(bucket->tags, 0, RoundUp(capacity, TAG_GROUP));
+  for (size_t i = 0; i < capacity; i++) {
+    new (&bucket->keys[i]) K();
+    new (&bucket->values[i]) V();
+  }
+  return bucket;
+}
+
+template <typename K, typename V, typename Hash>
+void ExtendibleHash<K, V, Hash>::Bucket::Destroy(Bucket *bucket) {
+  for (size_t i = 0; i < bucket->capacity; i++) {
+    bucket->keys[i].~K();
+    bucket->values[i].~V();
+  }
+  bucket->~Bucket();
+  free(bucket);
+}
+
+/*
+ * Also run by OptimisticFind while a writer may be changing the bucket, so
+ * count is read once and kept within the arrays.
+ */
+template <typename K, typename V, typename Hash>
+int ExtendibleHash<K, V, Hash>::Bucket::Locate(const K &key, uint8_t tag) const {
+  size_t used = std::min(count, capacity);
+  for (size_t group = 0; group < used; group += TAG_GROUP) {
+    uint32_t match = MatchTags(&tags[group], tag);
+    // tags past count are stale
+    if (used - group < TAG_GROUP) {
+      match &= (1u << (used - group)) - 1;
+    }
+    while (match != 0) {
+      size_t slot = group + __builtin_ctz(match);
+      if (keys[slot] == key) {
+        return static_cast<int>(slot);
+      }
+      match &= match - 1;
+    }
+  }
+  return -1;
+}
+
+template <typename K, typename V, typename Hash>
+void ExtendibleHash<K, V, Hash>::Bucket::BeginWrite() {
+  version.store(version.load(std::memory_order_relaxed) + 1,
+                std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+}
+
+template <typename K, typename V, typename Hash>
+void ExtendibleHash<K, V, Hash>::Bucket::EndWrite() {
+  version.store(version.load(std::memory_order_relaxed) + 1,
+                std::memory_order_release);
+}
+
+// slots an Insert fills into a doubled directory
+static const size_t MIGRATE_STEP = 64;
+// buddies are merged when their entries fill at most this share of a bucket,
+// leaving room so that the next inserts do not split them right away
+static const size_t MERGE_DIVISOR = 2;
+
+template <typename K, typename V, typename Hash>
+ExtendibleHash<K, V, Hash>::Directory::Directory(int depth, Directory *previous)
+    : globalDepth(depth),
+      slots(static_cast<std::atomic<Bucket *> *>(
+          calloc(size_t(1) << depth, sizeof(std::atomic<Bucket *>)))),
+      previous(previous), migrated(0) {}
+
+template <typename K, typename V, typename Hash>
+ExtendibleHash<K, V, Hash>::Directory::~Directory() {
+  free(slots);
+}
+
 /*
  * constructor
  * array_size: fixed array size for each bucket
+ * min_depth: Remove never halves the directory below this global depth
  */
-template <typename K, typename V>
-ExtendibleHash<K, V>::ExtendibleHash(size_t size) : globalDepth(0),buketSize(size),bucketNum(1){
-  BucketTable.push_back(std::make_shared<Bucket>(0));
+template <typename K, typename V, typename Hash>
+ExtendibleHash<K, V, Hash>::ExtendibleHash(size_t size, int min_depth,
+                                           const Hash &hash)
+    : hasher(hash),globalDepth(0),minDepth(std::max(min_depth, 0)),
+      buketSize(size),bucketNum(1),housekeepingDue(false){
+  if (buketSize == 0) buketSize = 1;
+  Directory *dir = new Directory(0, nullptr);
+  dir->slots[0].store(Bucket::Create(0, buketSize));
+  dir->migrated.store(1);
+  directory.store(dir);
+  depthCount.push_back(1);
 }
 // constructor with no param
-template <typename K, typename V>
-ExtendibleHash<K, V>::ExtendibleHash(){
-  ExtendibleHash(64);
+template <typename K, typename V, typename Hash>
+ExtendibleHash<K, V, Hash>::ExtendibleHash() : ExtendibleHash(64) {}
+
+/*
+ * No thread may use the table any more, so everything goes at once.
+ */
+template <typename K, typename V, typename Hash>
+ExtendibleHash<K, V, Hash>::~ExtendibleHash() {
+  Directory *dir = directory.load();
+  std::unordered_set<Bucket *> live;
+  for (size_t i = 0; i < (size_t(1) << dir->globalDepth); i++) {
+    live.insert(Slot(dir, i));
+  }
+  for (Bucket *bucket : live) {
+    Bucket::Destroy(bucket);
+  }
+  // a directory still being filled in keeps the one it doubled from
+  while (dir != nullptr) {
+    Directory *previous = dir->migrated.load() < (size_t(1) << dir->globalDepth)
+                              ? dir->previous : nullptr;
+    delete dir;
+    dir = previous;
+  }
+  for (auto &retired : retiredBuckets) {
+    Bucket::Destroy(retired.second);
+  }
+  for (auto &retired : retiredDirectories) {
+    delete retired.second;
+  }
 }
+
 /*
  * helper function to calculate the hashing address of input key
  */
-template <typename K, typename V>
-size_t ExtendibleHash<K, V>::HashKey(const K &key) const {
+template <typename K, typename V, typename Hash>
+size_t ExtendibleHash<K, V, Hash>::HashKey(const K &key) const {
   // return hashvalue of key in type of K
-  return std::hash<K>{}(key);
+  return hasher(key);
+}
+
+/*
+ * The directory indexes by the low bits of the hash; the fingerprint is
+ * taken from the high bits of the hash multiplied by an odd constant, so it
+ * depends on all bits even with a hasher that does not mix its output.
+ */
+template <typename K, typename V, typename Hash>
+uint8_t ExtendibleHash<K, V, Hash>::Fingerprint(size_t hash) {
+  return static_cast<uint8_t>((static_cast<uint64_t>(hash) * 0x9E3779B97F4A7C15ULL) >> 56);
 }
 
 /*
  * helper function to return global depth of hash table
  * NOTE: you must implement this function in order to pass test
  */
-template <typename K, typename V>
-int ExtendibleHash<K, V>::GetGlobalDepth() const {
+template <typename K, typename V, typename Hash>
+int ExtendibleHash<K, V, Hash>::GetGlobalDepth() const {
   std::lock_guard<std::mutex> lock(tableLatch);
   return globalDepth;
 }
@@ -42,61 +236,364 @@ int ExtendibleHash<K, V>::GetGlobalDepth() const {
  * helper function to return local depth of one specific bucket
  * NOTE: you must implement this function in order to pass test
  */
-template <typename K, typename V>
-int ExtendibleHash<K, V>::GetLocalDepth(int bucket_id) const {
-  if(!BucketTable[bucket_id])
+template <typename K, typename V, typename Hash>
+int ExtendibleHash<K, V, Hash>::GetLocalDepth(int bucket_id) const {
+  EpochGuard guard;
+  Directory *dir = directory.load();
+  if(bucket_id < 0 || static_cast<size_t>(bucket_id) >= (size_t(1) << dir->globalDepth))
     return -1;
-  std::lock_guard<std::mutex> lck(BucketTable[bucket_id]->latch);
-  if(BucketTable[bucket_id]->items.empty()) return -1;
-  return BucketTable[bucket_id]->localDepth;
+  Bucket *bucket = Slot(dir, bucket_id);
+  std::lock_guard<std::mutex> lck(bucket->latch);
+  if(bucket->count == 0) return -1;
+  return bucket->localDepth;
 }
 
 /*
  * helper function to return current number of bucket in hash table
  */
-template <typename K, typename V>
-int ExtendibleHash<K, V>::GetNumBuckets() const {
+template <typename K, typename V, typename Hash>
+int ExtendibleHash<K, V, Hash>::GetNumBuckets() const {
   std::lock_guard<mutex> lock(tableLatch);
   return bucketNum;
 }
 
-template <typename K, typename V>
-int ExtendibleHash<K, V>::getBucketIndex(const K &key) const {
-  std::lock_guard<std::mutex> lck(tableLatch);
-  return HashKey(key) & ((1 << globalDepth)-1);
+template <typename K, typename V, typename Hash>
+size_t ExtendibleHash<K, V, Hash>::MemoryUsage() const {
+  std::lock_guard<mutex> lock(tableLatch);
+  auto directory_bytes = [](const Directory *dir) {
+    return sizeof(Directory) + (sizeof(std::atomic<Bucket *>) << dir->globalDepth);
+  };
+  size_t tags_at, keys_at, values_at;
+  size_t bucket_bytes = Bucket::Layout(buketSize, tags_at, keys_at, values_at);
+  Directory *dir = directory.load();
+  size_t bytes = sizeof(*this) + directory_bytes(dir) +
+                 (bucketNum + retiredBuckets.size()) * bucket_bytes +
+                 depthCount.capacity() * sizeof(size_t);
+  while (dir->migrated.load() < (size_t(1) << dir->globalDepth)) {
+    dir = dir->previous;
+    bytes += directory_bytes(dir);
+  }
+  for (auto &retired : retiredDirectories) {
+    bytes += directory_bytes(retired.second);
+  }
+  return bytes;
+}
+
+/*
+ * The counters are read under tableLatch, the buckets one latch at a time
+ * afterwards (Merge latches a bucket before tableLatch). A bucket of local
+ * depth d fills every 2^d-th slot of the directory and is counted at the
+ * first of them, the one below 2^d.
+ */
+template <typename K, typename V, typename Hash>
+typename ExtendibleHash<K, V, Hash>::Diagnostics
+ExtendibleHash<K, V, Hash>::GetDiagnostics() const {
+  Diagnostics diagnostics;
+  {
+    std::lock_guard<mutex> lock(tableLatch);
+    diagnostics.splits = splitCount;
+    diagnostics.merges = mergeCount;
+    diagnostics.doublings = doublingCount;
+    diagnostics.shrinks = shrinkCount;
+  }
+  EpochGuard guard;
+  Directory *dir = directory.load();
+  diagnostics.globalDepth = dir->globalDepth;
+  diagnostics.occupancy.assign(buketSize + 1, 0);
+  diagnostics.localDepths.assign(dir->globalDepth + 1, 0);
+  for (size_t i = 0; i < (size_t(1) << dir->globalDepth); i++) {
+    Bucket *bucket = Slot(dir, i);
+    std::lock_guard<std::mutex> lck(bucket->latch);
+    if (bucket->localDepth > dir->globalDepth ||
+        i >= (size_t(1) << bucket->localDepth)) {
+      continue;
+    }
+    diagnostics.numBuckets++;
+    diagnostics.numEntries += bucket->count;
+    diagnostics.occupancy[bucket->count]++;
+    diagnostics.localDepths[bucket->localDepth]++;
+  }
+  return diagnostics;
+}
+
+template <typename K, typename V, typename Hash>
+typename ExtendibleHash<K, V, Hash>::Bucket *
+ExtendibleHash<K, V, Hash>::Slot(const Directory *dir, size_t index) {
+  Bucket *bucket = dir->slots[index].load(std::memory_order_acquire);
+  while (bucket == nullptr) {
+    dir = dir->previous;
+    index &= (size_t(1) << dir->globalDepth) - 1;
+    bucket = dir->slots[index].load(std::memory_order_acquire);
+  }
+  return bucket;
+}
+
+/*
+ * Copy the next slots of dir over from the directory it doubled from. A
+ * slot a split already set is left alone. Only writers holding tableLatch
+ * store into slots, readers follow empty slots to previous meanwhile.
+ */
+template <typename K, typename V, typename Hash>
+void ExtendibleHash<K, V, Hash>::MigrateStep(Directory *dir, size_t steps) {
+  size_t length = size_t(1) << dir->globalDepth;
+  size_t from = dir->migrated.load(std::memory_order_relaxed);
+  size_t to = length - from > steps ? from + steps : length;
+  for (size_t i = from; i < to; i++) {
+    if (dir->slots[i].load(std::memory_order_relaxed) == nullptr) {
+      dir->slots[i].store(Slot(dir->previous, i & (length / 2 - 1)),
+                          std::memory_order_release);
+    }
+  }
+  dir->migrated.store(to, std::memory_order_relaxed);
+  // the last empty slot is gone, new lookups no longer need previous, nor
+  // the directories an unfinished previous still leads to
+  if (from < length && to == length) {
+    uint64_t epoch = EpochManager::Instance().RetireEpoch();
+    Directory *old = dir->previous;
+    while (old != nullptr) {
+      retiredDirectories.emplace_back(epoch, old);
+      old = old->migrated.load(std::memory_order_relaxed) <
+                    (size_t(1) << old->globalDepth)
+                ? old->previous : nullptr;
+    }
+  }
+}
+
+/*
+ * Writers take turns filling in a doubled directory and freeing retired
+ * memory; one that would have to wait for tableLatch leaves it to others.
+ */
+template <typename K, typename V, typename Hash>
+void ExtendibleHash<K, V, Hash>::Housekeeping() {
+  if (!housekeepingDue.load(std::memory_order_relaxed)) {
+    return;
+  }
+  std::unique_lock<std::mutex> lck(tableLatch, std::try_to_lock);
+  if (lck.owns_lock()) {
+    MigrateStep(directory.load(std::memory_order_relaxed), MIGRATE_STEP);
+    Reclaim();
+  }
+}
+
+template <typename K, typename V, typename Hash>
+void ExtendibleHash<K, V, Hash>::Reclaim() {
+  EpochManager &epochs = EpochManager::Instance();
+  while (!retiredBuckets.empty() && epochs.CanFree(retiredBuckets.front().first)) {
+    Bucket::Destroy(retiredBuckets.front().second);
+    retiredBuckets.pop_front();
+  }
+  while (!retiredDirectories.empty() &&
+         epochs.CanFree(retiredDirectories.front().first)) {
+    delete retiredDirectories.front().second;
+    retiredDirectories.pop_front();
+  }
+  Directory *dir = directory.load(std::memory_order_relaxed);
+  housekeepingDue.store(
+      !retiredBuckets.empty() || !retiredDirectories.empty() ||
+          dir->migrated.load(std::memory_order_relaxed) < (size_t(1) << dir->globalDepth),
+      std::memory_order_relaxed);
+}
+
+/*
+ * Latch the bucket the key with hash maps to. The directory is read without
+ * tableLatch, so after latching check that it still maps hash to the bucket
+ * (a split or doubling may have run meanwhile) and retry if not.
+ */
+template <typename K, typename V, typename Hash>
+typename ExtendibleHash<K, V, Hash>::Bucket *
+ExtendibleHash<K, V, Hash>::LockBucket(size_t hash, std::unique_lock<std::mutex> &lck) const {
+  while (true) {
+    Directory *dir = directory.load(std::memory_order_acquire);
+    size_t index = hash & ((size_t(1) << dir->globalDepth) - 1);
+    Bucket *bucket = Slot(dir, index);
+    lck = std::unique_lock<std::mutex>(bucket->latch);
+    if (directory.load(std::memory_order_acquire) == dir &&
+        Slot(dir, index) == bucket) {
+      return bucket;
+    }
+    lck.unlock();
+  }
+}
+
+/*
+ * Find without latches: read the bucket between two loads of its version
+ * and retry when a writer was active (odd version) or finished in between
+ * (version changed). The directory is checked again after the first load,
+ * as a split that completed before it moves entries out of the bucket
+ * without leaving a change to see.
+ */
+template <typename K, typename V, typename Hash>
+bool ExtendibleHash<K, V, Hash>::OptimisticFind(size_t hash, const K &key, V &value) const {
+  uint8_t tag = Fingerprint(hash);
+  while (true) {
+    Directory *dir = directory.load(std::memory_order_acquire);
+    size_t index = hash & ((size_t(1) << dir->globalDepth) - 1);
+    Bucket *bucket = Slot(dir, index);
+    uint32_t before = bucket->version.load(std::memory_order_acquire);
+    if ((before & 1) != 0 ||
+        directory.load(std::memory_order_acquire) != dir ||
+        Slot(dir, index) != bucket) {
+      continue;
+    }
+    int slot = bucket->Locate(key, tag);
+    V found = slot >= 0 ? bucket->values[slot] : V();
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (bucket->version.load(std::memory_order_relaxed) != before) {
+      continue;
+    }
+    if (slot < 0) {
+      return false;
+    }
+    value = found;
+    return true;
+  }
 }
 
 /*
  * lookup function to find value associate with input key
  */
-template <typename K, typename V>
-bool ExtendibleHash<K, V>::Find(const K &key, V &value) {
-  int index = getBucketIndex(key);
-  std::lock_guard<std::mutex> lck(BucketTable[index]->latch);
-  std::shared_ptr<Bucket> bucket = BucketTable[index];
-  //find() will return iterator pointing to the end of map if not found
-  if(bucket != nullptr && bucket->items.find(key)!= bucket->items.end()){
-    value = bucket->items[key];
+template <typename K, typename V, typename Hash>
+bool ExtendibleHash<K, V, Hash>::Find(const K &key, V &value) {
+  EpochGuard guard;
+  size_t hash = HashKey(key);
+  if (OPTIMISTIC_FIND) {
+    return OptimisticFind(hash, key, value);
+  }
+  std::unique_lock<std::mutex> lck;
+  Bucket *bucket = LockBucket(hash, lck);
+  int slot = bucket->Locate(key, Fingerprint(hash));
+  if(slot >= 0){
+    value = bucket->values[slot];
     return true;
   }
-  
+
   return false;
 }
 
 /*
  * delete <key,value> entry in hash table
- * Shrink & Combination is not required for this project
- */
-template <typename K, typename V>
-bool ExtendibleHash<K, V>::Remove(const K &key) {
-  int index = getBucketIndex(key);
-  std::lock_guard<std::mutex> lck(BucketTable[index]->latch);
-  std::shared_ptr<Bucket> cur = BucketTable[index];
-  if(cur->items.find(key)!=cur->items.end()){
-    cur->items.erase(key);
-    return true;
+ * A bucket left at most 1/MERGE_DIVISOR full is merged with its buddy if
+ * that is about as empty, and the directory shrinks when it can.
+ */
+template <typename K, typename V, typename Hash>
+bool ExtendibleHash<K, V, Hash>::Remove(const K &key) {
+  EpochGuard guard;
+  Housekeeping();
+  size_t hash = HashKey(key);
+  std::unique_lock<std::mutex> lck;
+  Bucket *cur = LockBucket(hash, lck);
+  int slot = cur->Locate(key, Fingerprint(hash));
+  if(slot < 0){
+    return false;
+  }
+  // the last entry fills the hole
+  cur->BeginWrite();
+  size_t last = --cur->count;
+  cur->tags[slot] = cur->tags[last];
+  cur->keys[slot] = cur->keys[last];
+  cur->values[slot] = cur->values[last];
+  cur->EndWrite();
+  if (cur->localDepth > 0 && cur->count <= buketSize / MERGE_DIVISOR) {
+    Merge(hash, cur);
+  }
+  return true;
+}
+
+/*
+ * The buddy of cur differs from it only in the highest bit of its local
+ * depth. It is only try-latched: a thread holding it may be waiting for
+ * cur, and a merge skipped now happens with a later Remove. Of the two, the
+ * bucket without that bit stays and takes over the slots of the other one.
+ * The merged bucket is tried against its own buddy in turn, otherwise an
+ * emptied bucket whose buddy was split deeper would never be merged: no
+ * Remove reaches it any more.
+ */
+template <typename K, typename V, typename Hash>
+void ExtendibleHash<K, V, Hash>::Merge(size_t hash, Bucket *cur) {
+  std::unique_lock<std::mutex> cur_lck;  // cur's latch once cur is a buddy
+  std::unique_lock<std::mutex> table_lck(tableLatch, std::defer_lock);
+  while (cur->localDepth > 0 && cur->count <= buketSize / MERGE_DIVISOR) {
+    size_t bit = size_t(1) << (cur->localDepth - 1);
+    Directory *dir = directory.load(std::memory_order_acquire);
+    size_t mask = (size_t(1) << dir->globalDepth) - 1;
+    Bucket *buddy = Slot(dir, (hash ^ bit) & mask);
+    if (buddy == cur) {
+      break;
+    }
+    std::unique_lock<std::mutex> buddy_lck(buddy->latch, std::try_to_lock);
+    if (!buddy_lck.owns_lock()) {
+      break;
+    }
+    if (!table_lck.owns_lock()) {
+      table_lck.lock();
+    }
+    // a doubling or a split of the buddy may have run before it was latched
+    dir = directory.load(std::memory_order_relaxed);
+    mask = (size_t(1) << dir->globalDepth) - 1;
+    if (Slot(dir, (hash ^ bit) & mask) != buddy ||
+        buddy->localDepth != cur->localDepth ||
+        cur->count + buddy->count > buketSize / MERGE_DIVISOR) {
+      break;
+    }
+    Bucket *keep = (hash & bit) ? buddy : cur;
+    Bucket *gone = keep == cur ? buddy : cur;
+    keep->BeginWrite();
+    gone->BeginWrite();
+    for (size_t i = 0; i < gone->count; i++) {
+      keep->tags[keep->count] = gone->tags[i];
+      keep->keys[keep->count] = gone->keys[i];
+      keep->values[keep->count] = gone->values[i];
+      keep->count++;
+    }
+    gone->count = 0;
+    depthCount[keep->localDepth] -= 2;
+    keep->localDepth--;
+    depthCount[keep->localDepth]++;
+    // every slot of gone is set, also empty ones that would lead to it
+    // through the previous directory
+    size_t length = size_t(1) << globalDepth;
+    for (size_t i = (hash & (bit - 1)) | bit; i < length; i += 2 * bit) {
+      dir->slots[i].store(keep, std::memory_order_release);
+    }
+    keep->EndWrite();
+    gone->EndWrite();
+    bucketNum--;
+    mergeCount++;
+    retiredBuckets.emplace_back(EpochManager::Instance().RetireEpoch(), gone);
+    if (keep == buddy) {
+      cur_lck = std::move(buddy_lck);
+    }
+    cur = keep;
+  }
+  if (table_lck.owns_lock()) {
+    Shrink();
+    Reclaim();
+  }
+}
+
+/*
+ * With no bucket at the global depth, the two halves of the directory are
+ * the same and the first one is all it takes. Copying it blocks writers,
+ * but unlike doubling this happens at most once per doubling.
+ */
+template <typename K, typename V, typename Hash>
+void ExtendibleHash<K, V, Hash>::Shrink() {
+  while (globalDepth > minDepth && depthCount[globalDepth] == 0) {
+    Directory *dir = directory.load(std::memory_order_relaxed);
+    MigrateStep(dir, size_t(1) << globalDepth);
+    size_t half = size_t(1) << (globalDepth - 1);
+    Directory *smaller = new Directory(globalDepth - 1, nullptr);
+    for (size_t i = 0; i < half; i++) {
+      smaller->slots[i].store(dir->slots[i].load(std::memory_order_relaxed),
+                              std::memory_order_relaxed);
+    }
+    smaller->migrated.store(half, std::memory_order_relaxed);
+    directory.store(smaller, std::memory_order_release);
+    retiredDirectories.emplace_back(EpochManager::Instance().RetireEpoch(), dir);
+    depthCount.pop_back();
+    globalDepth--;
+    shrinkCount++;
   }
-  return false;
 }
 
 /*
@@ -104,50 +601,75 @@ bool ExtendibleHash<K, V>::Remove(const K &key) {
  * Split & Redistribute bucket when there is overflow and if necessary increase
  * global depth
  */
-template <typename K, typename V>
-void ExtendibleHash<K, V>::Insert(const K &key, const V &value) {
-  int index = getBucketIndex(key);
-  std::shared_ptr<Bucket> cur = BucketTable[index];
+template <typename K, typename V, typename Hash>
+void ExtendibleHash<K, V, Hash>::Insert(const K &key, const V &value) {
+  EpochGuard guard;
+  size_t hash = HashKey(key);
+  uint8_t tag = Fingerprint(hash);
+  Housekeeping();
   while (true) {
-    std::lock_guard<std::mutex> lck(cur->latch);
+    std::unique_lock<std::mutex> lck;
+    Bucket *cur = LockBucket(hash, lck);
     //no need to expansion
-    if (cur->items.find(key) != cur->items.end() || cur->items.size() < buketSize) {
-      cur->items[key] = value;
+    int slot = cur->Locate(key, tag);
+    if (slot >= 0) {
+      cur->BeginWrite();
+      cur->values[slot] = value;
+      cur->EndWrite();
+      break;
+    }
+    if (cur->count < buketSize) {
+      cur->BeginWrite();
+      cur->tags[cur->count] = tag;
+      cur->keys[cur->count] = key;
+      cur->values[cur->count] = value;
+      cur->count++;
+      cur->EndWrite();
       break;
     }
     // Bucket splitting
-    int mask = (1 << (cur->localDepth));
+    lock_guard<mutex> lck2(tableLatch);
+    cur->BeginWrite();
+    size_t mask = (size_t(1) << (cur->localDepth));
     cur->localDepth++;
+    Directory *dir = directory.load(std::memory_order_relaxed);
+    // directory dilatation: publish an empty one twice the size, Inserts
+    // fill it in. The last one need not be finished: a split that doubles
+    // several times in a row leaves a chain of directories, each filled in
+    // only up to where it was replaced, and lookups follow the chain back
+    // until they find a slot that is set.
+    if (cur->localDepth > globalDepth) {
+      Directory *bigger = new Directory(globalDepth + 1, dir);
+      directory.store(bigger, std::memory_order_release);
+      dir = bigger;
+      globalDepth++;
+      depthCount.push_back(0);
+      doublingCount++;
+    }
+    bucketNum++;
+    splitCount++;
+    depthCount[cur->localDepth - 1]--;
+    depthCount[cur->localDepth] += 2;
+    Bucket *newBuc = Bucket::Create(cur->localDepth, buketSize);
 
-    {
-      lock_guard<mutex> lck2(tableLatch);
-      // BucketTable dilatation
-      if (cur->localDepth > globalDepth) {
-
-        size_t length = BucketTable.size();
-        for (size_t i = 0; i < length; i++) {
-          BucketTable.push_back(BucketTable[i]);
-        } 
-        globalDepth++;
-
-      }
-      bucketNum++;
-      auto newBuc = make_shared<Bucket>(cur->localDepth);
-
-      typename map<K, V>::iterator it;
-      for (it = cur->items.begin(); it != cur->items.end(); ) {
-        if (HashKey(it->first) & mask) {
-          newBuc->items[it->first] = it->second;
-          it = cur->items.erase(it);
-        } else it++;
-      }
-      for (size_t i = 0; i < BucketTable.size(); i++) {
-        if (BucketTable[i] == cur && (i & mask))
-          BucketTable[i] = newBuc;
-      }
+    // one pass: entries with the new bit set move, the rest close up
+    size_t kept = 0;
+    for (size_t i = 0; i < cur->count; i++) {
+      Bucket *to = (HashKey(cur->keys[i]) & mask) ? newBuc : cur;
+      size_t slot = to == cur ? kept++ : newBuc->count++;
+      to->tags[slot] = cur->tags[i];
+      to->keys[slot] = cur->keys[i];
+      to->values[slot] = cur->values[i];
+    }
+    cur->count = kept;
+    // the slots of cur are those equal to hash in its old depth's bits,
+    // every other one of them has the new bit set
+    size_t length = size_t(1) << globalDepth;
+    for (size_t i = (hash & (mask - 1)) | mask; i < length; i += 2 * mask) {
+      dir->slots[i].store(newBuc, std::memory_order_release);
     }
-    index = getBucketIndex(key);
-    cur = BucketTable[index];
+    cur->EndWrite();
+    Reclaim();
   }
 }
 
@@ -157,4 +679,7 @@ template class ExtendibleHash<Page *, std::list<Page *>::iterator>;
 template class ExtendibleHash<int, std::string>;
 template class ExtendibleHash<int, std::list<int>::iterator>;
 template class ExtendibleHash<int, int>;
+// tests that check depths computed with the identity hash
+template class ExtendibleHash<int, std::string, std::hash<int>>;
+template class ExtendibleHash<int, int, std::hash<int>>;
 } // namespace scudb
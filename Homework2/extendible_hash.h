@@ -9,38 +9,119 @@
 
 #pragma once
 
+#include <atomic>
+#include <cstdint>
 #include <cstdlib>
+#include <deque>
+#include <type_traits>
 #include <vector>
 #include <string>
-#include <map>
 #include <mutex>
 #include <memory>
 
+#include "hash/epoch_manager.h"
+#include "hash/hash_function.h"
 #include "hash/hash_table.h"
 using namespace std;
 
 namespace scudb {
 
-template <typename K, typename V>
+// Hash defaults to MixHash (hash_function.h), so strided or aligned keys
+// still spread over the low bits the directory indexes by. Tests whose
+// expected depths are worked out by hand pass std::hash, the identity on
+// integers.
+template <typename K, typename V, typename Hash = MixHash<K>>
 class ExtendibleHash : public HashTable<K, V> {
+  /*
+   * A bucket keeps its entries in flat arrays of fixed capacity, slots
+   * [0, count) in use. tags holds a one byte fingerprint of every key's hash;
+   * a lookup compares the tags a group at a time (see MatchTags) and only
+   * looks at the keys whose tag matches.
+   * The bucket and its arrays are one cache line aligned block (see Create):
+   * the fields a lookup reads fill the first line, the tags start on the
+   * next one and keys and values follow them, so a lookup touches the
+   * header line, one tag line and the lines of the matching keys.
+   * Writers hold latch and wrap every change in BeginWrite/EndWrite, which
+   * make version odd while the bucket is changing (a seqlock for Find).
+   */
   struct Bucket{
-    /* data */
-    explicit Bucket(int depth) : localDepth(depth) {};
+    // allocate and construct a bucket with capacity entries, and undo that
+    static Bucket *Create(int depth, size_t capacity);
+    static void Destroy(Bucket *bucket);
+    // bytes of the block of a bucket with capacity entries; the arrays
+    // start at the offsets stored through tags_at, keys_at and values_at
+    static size_t Layout(size_t capacity, size_t &tags_at, size_t &keys_at,
+                         size_t &values_at);
+    // slot of key, -1 if it is not in the bucket
+    int Locate(const K &key, uint8_t tag) const;
+    void BeginWrite();
+    void EndWrite();
+    std::atomic<uint32_t> version;
     int localDepth;
-    std::map<K,V> items;
+    size_t count;
+    size_t capacity;
+    uint8_t *tags; // padded to whole groups
+    K *keys;
+    V *values;
     mutex latch;
+
+  private:
+    Bucket(int depth, size_t capacity);
+  };
+  // 2^globalDepth bucket pointers; replaced (not resized) when it doubles.
+  // A doubled directory starts out empty and is filled in a few slots per
+  // Insert (see MigrateStep); an empty slot i stands for slot
+  // i & (2^(globalDepth-1) - 1) of previous, which may be empty in turn
+  // when previous was replaced before it was filled in.
+  struct Directory{
+    Directory(int depth, Directory *previous);
+    ~Directory();
+    int globalDepth;
+    // calloc'ed: large directories get zero pages from the OS on first
+    // touch, so publishing one does not stall on clearing it
+    std::atomic<Bucket *> *slots;
+    Directory *const previous;
+    std::atomic<size_t> migrated; // slots below are filled in
   };
+  // Find reads buckets without their latch when a torn copy of an entry is
+  // harmless, i.e. the version check can throw it away
+  static const bool OPTIMISTIC_FIND = std::is_trivially_copyable<K>::value &&
+                                      std::is_trivially_copyable<V>::value;
   
 public:
+  // how well the hash spreads the keys, see GetDiagnostics
+  struct Diagnostics {
+    int globalDepth = 0;
+    size_t numBuckets = 0;
+    size_t numEntries = 0;
+    // occupancy[n]: buckets holding n entries, n up to the bucket size
+    vector<size_t> occupancy;
+    // localDepths[d]: buckets of local depth d, d up to globalDepth
+    vector<size_t> localDepths;
+    // since construction
+    size_t splits = 0;
+    size_t merges = 0;
+    size_t doublings = 0;
+    size_t shrinks = 0;
+  };
+
   // constructor
-  ExtendibleHash(size_t size);
+  ExtendibleHash(size_t size, int min_depth = 0, const Hash &hash = Hash());
   ExtendibleHash();
+  ~ExtendibleHash();
   // helper function to generate hash addressing
   size_t HashKey(const K &key) const;
+  // fingerprint of a key's hash kept in its bucket
+  static uint8_t Fingerprint(size_t hash);
   // helper function to get global & local depth
   int GetGlobalDepth() const;
   int GetLocalDepth(int bucket_id) const;
   int GetNumBuckets() const;
+  // bytes held by the directory and buckets, including those waiting to be
+  // freed; memory the keys and values own themselves is not counted
+  size_t MemoryUsage() const;
+  // a snapshot of the buckets; only exact while no writer is running
+  Diagnostics GetDiagnostics() const;
   // lookup and modifier
   bool Find(const K &key, V &value) override;
   bool Remove(const K &key) override;
@@ -49,11 +130,43 @@ public:
 
 private:
   // add your own member variables here
-  int getBucketIndex(const K &key) const;
+  // bucket of the key with this hash, returned with its latch held by lck
+  Bucket *LockBucket(size_t hash, std::unique_lock<std::mutex> &lck) const;
+  // bucket of slot index of dir, looked up in previous if not filled in yet
+  static Bucket *Slot(const Directory *dir, size_t index);
+  // fill in up to steps more slots of dir, tableLatch held
+  void MigrateStep(Directory *dir, size_t steps);
+  // join the bucket cur (latched) with its buddy if they fit in one
+  void Merge(size_t hash, Bucket *cur);
+  // halve the directory while no bucket needs its depth, down to minDepth;
+  // tableLatch held
+  void Shrink();
+  // MigrateStep and Reclaim, if there is work and tableLatch is free
+  void Housekeeping();
+  // free what no reader can reach any more, tableLatch held
+  void Reclaim();
+  bool OptimisticFind(size_t hash, const K &key, V &value) const;
+  Hash hasher;
   int globalDepth;
+  int minDepth;    // see the constructor
   size_t buketSize;
   int bucketNum;
-  vector<shared_ptr<Bucket>> BucketTable;
+  // current directory, read by Find without any latch; splits and merges
+  // change its slots, doubling and shrinking replace it, under tableLatch
+  std::atomic<Directory *> directory;
+  // buckets per local depth, the directory can halve when none has its depth
+  vector<size_t> depthCount;
+  // unlinked buckets and directories with the epoch they were unlinked
+  // at; a latch-free reader may still be looking at them
+  deque<pair<uint64_t, Bucket *>> retiredBuckets;
+  deque<pair<uint64_t, Directory *>> retiredDirectories;
+  // a directory is being filled in or something is retired, see Reclaim
+  std::atomic<bool> housekeepingDue;
+  // structural changes for GetDiagnostics, tableLatch held
+  size_t splitCount = 0;
+  size_t mergeCount = 0;
+  size_t doublingCount = 0;
+  size_t shrinkCount = 0;
   // mutable make tablelatch can use in const
   mutable std::mutex tableLatch;
 };
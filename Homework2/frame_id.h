@@ -0,0 +1,18 @@
+/*
+ * frame_id.h : frame ids of the buffer pool
+ *
+ * Functionality: the type a buffer pool instance numbers its frames with,
+ * and what its replacers are instantiated for. It belongs next to page_id_t
+ * in common/config.h, which is outside the homework sources.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+namespace scudb {
+
+// index of a frame within its buffer pool instance
+typedef int32_t frame_id_t;
+
+} // namespace scudb
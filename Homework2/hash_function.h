@@ -0,0 +1,38 @@
+/*
+ * hash_function.h : default hasher of the hash tables
+ *
+ * Functionality: std::hash is the identity for integers and pointers, and
+ * a table indexing by the low bits of the hash then sends sequential or
+ * strided keys (page ids of one buffer pool instance, aligned pointers) to
+ * the same few buckets. MixHash runs std::hash through a finalizer
+ * that spreads every input bit over the whole word, so any subset of the
+ * bits is as good an index as any other. It is the default Hash of
+ * ExtendibleHash.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+
+namespace scudb {
+
+/*
+ * The avalanche step of xxh3: a multiply mixes each bit into the higher
+ * ones, the shifts fold the high bits back down.
+ */
+inline uint64_t HashMix(uint64_t x) {
+  x ^= x >> 37;
+  x *= 0x165667919E3779F9ULL;
+  x ^= x >> 32;
+  return x;
+}
+
+template <typename K> struct MixHash {
+  size_t operator()(const K &key) const {
+    return static_cast<size_t>(HashMix(std::hash<K>{}(key)));
+  }
+};
+
+} // namespace scudb
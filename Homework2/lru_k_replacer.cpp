@@ -0,0 +1,151 @@
+/**
+ * LRU-K implementation
+ */
+#include "buffer/lru_k_replacer.h"
+#include "buffer/frame_id.h"
+#include "page/page.h"
+
+namespace scudb {
+
+template <typename T> const size_t LRUKReplacer<T>::NOT_IN_HEAP;
+
+template <typename T>
+LRUKReplacer<T>::LRUKReplacer(size_t k, uint64_t correlated_period,
+                              std::function<page_id_t(const T &)> key)
+    : k(k == 0 ? 1 : k), correlated_period(correlated_period), clock(0),
+      key(key) {}
+
+template <typename T> LRUKReplacer<T>::~LRUKReplacer() {}
+
+template <typename T> bool LRUKReplacer<T>::Before(size_t a, size_t b) const {
+  bool a_infinite = accesses[a] < k, b_infinite = accesses[b] < k;
+  if(a_infinite != b_infinite){
+    return a_infinite;
+  }
+  // k-th most recent stamp, or the latest one for infinite distances
+  uint64_t a_stamp = history[a * k + (a_infinite ? 0 : k - 1)];
+  uint64_t b_stamp = history[b * k + (b_infinite ? 0 : k - 1)];
+  return a_stamp < b_stamp;
+}
+
+template <typename T> void LRUKReplacer<T>::Swap(size_t i, size_t j) {
+  std::swap(heap[i], heap[j]);
+  position[heap[i]] = i;
+  position[heap[j]] = j;
+}
+
+template <typename T> void LRUKReplacer<T>::SiftUp(size_t i) {
+  while(i > 0 && Before(heap[i], heap[(i - 1) / 2])){
+    Swap(i, (i - 1) / 2);
+    i = (i - 1) / 2;
+  }
+}
+
+template <typename T> void LRUKReplacer<T>::SiftDown(size_t i) {
+  while(true){
+    size_t first = i, left = 2 * i + 1, right = 2 * i + 2;
+    if(left < heap.size() && Before(heap[left], heap[first])) first = left;
+    if(right < heap.size() && Before(heap[right], heap[first])) first = right;
+    if(first == i) return;
+    Swap(i, first);
+    i = first;
+  }
+}
+
+template <typename T> void LRUKReplacer<T>::HeapRemove(size_t i) {
+  size_t slot = heap[i];
+  Swap(i, heap.size() - 1);
+  heap.pop_back();
+  position[slot] = NOT_IN_HEAP;
+  if(i < heap.size()){
+    SiftDown(i);
+    SiftUp(i);
+  }
+}
+
+/*
+ * Record an access to value and make it evictable
+ */
+template <typename T> void LRUKReplacer<T>::Insert(const T &value) {
+  std::lock_guard<std::mutex> lck(latch);
+  size_t slot;
+  page_id_t page_id = key ? key(value) : INVALID_PAGE_ID;
+  if(!slots.Find(value, slot)){
+    slot = values.size();
+    slots.Add(value, slot);
+    values.push_back(value);
+    keys.push_back(page_id);
+    history.resize(history.size() + k, 0);
+    accesses.push_back(0);
+    position.push_back(NOT_IN_HEAP);
+  }else if(keys[slot] != page_id){
+    // another page in the same frame, the history is not its own
+    if(position[slot] != NOT_IN_HEAP){
+      HeapRemove(position[slot]);
+    }
+    accesses[slot] = 0;
+    keys[slot] = page_id;
+  }
+  uint64_t now = ++clock;
+  uint64_t *stamps = &history[slot * k];
+  if(accesses[slot] > 0 && now - stamps[0] <= correlated_period){
+    // same burst as the previous access
+    stamps[0] = now;
+  }else{
+    for(size_t i = k - 1; i > 0; i--){
+      stamps[i] = stamps[i - 1];
+    }
+    stamps[0] = now;
+    if(accesses[slot] < k){
+      accesses[slot]++;
+    }
+  }
+  if(position[slot] == NOT_IN_HEAP){
+    position[slot] = heap.size();
+    heap.push_back(slot);
+    SiftUp(heap.size() - 1);
+  }else{
+    // the stamps only grew, so the value can only move down
+    SiftDown(position[slot]);
+  }
+}
+
+/*
+ * Evict the value with the largest backward k-distance. Its frame is about
+ * to hold another page, so its history is dropped.
+ */
+template <typename T> bool LRUKReplacer<T>::Victim(T &value) {
+  std::lock_guard<std::mutex> lck(latch);
+  if(heap.empty()){
+    return false;
+  }
+  size_t slot = heap[0];
+  HeapRemove(0);
+  accesses[slot] = 0;
+  value = values[slot];
+  return true;
+}
+
+/*
+ * Remove value from the candidates (it got pinned), keeping its history
+ */
+template <typename T> bool LRUKReplacer<T>::Erase(const T &value) {
+  std::lock_guard<std::mutex> lck(latch);
+  size_t slot;
+  if(!slots.Find(value, slot) || position[slot] == NOT_IN_HEAP){
+    return false;
+  }
+  HeapRemove(position[slot]);
+  return true;
+}
+
+template <typename T> size_t LRUKReplacer<T>::Size() {
+  std::lock_guard<std::mutex> lck(latch);
+  return heap.size();
+}
+
+template class LRUKReplacer<Page *>;
+// frame ids of the buffer pool, also what the tests use
+template class LRUKReplacer<frame_id_t>;
+
+} // namespace scudb
@@ -0,0 +1,78 @@
+/**
+ * lru_k_replacer.h
+ *
+ * Functionality: LRU-K replacement. Every Insert (the unpin that ends a use
+ * of a frame) counts as an access to the value and is stamped with a logical
+ * clock; the last K stamps are kept. Victim evicts the value with the largest
+ * backward K-distance, i.e. the oldest K-th most recent access. Values with
+ * fewer than K accesses have an infinite distance and go first, least
+ * recently used among them first. An access following the previous one of
+ * the same value within correlated_period ticks belongs to the same burst: it
+ * refreshes the latest stamp instead of adding a new one, so a burst counts
+ * as one access. Erase (a page that got pinned since it was inserted) takes
+ * the value out of the candidates and keeps its history. Given a key, a value whose
+ * page id changed since it was last seen (its frame was reused without
+ * Victim, e.g. after a delete) starts over with no history, as in
+ * ARCReplacer.
+ * The candidates are kept in an indexed binary heap, making Insert, Erase and
+ * Victim O(log n).
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+#include "buffer/replacer.h"
+#include "buffer/slot_map.h"
+#include "common/config.h"
+
+using namespace std;
+namespace scudb {
+
+template <typename T> class LRUKReplacer : public Replacer<T> {
+public:
+
+  // correlated_period is counted in Inserts; the default is wide enough to
+  // fold a scan's read-ahead and its repeated pins of a leaf into one access.
+  // key: the page id a value holds at the time of the call, if values are
+  // frames
+  explicit LRUKReplacer(size_t k = 2, uint64_t correlated_period = 32,
+                        std::function<page_id_t(const T &)> key = nullptr);
+
+  ~LRUKReplacer();
+
+  void Insert(const T &value);
+
+  bool Victim(T &value);
+
+  bool Erase(const T &value);
+
+  size_t Size();
+
+private:
+  static const size_t NOT_IN_HEAP = static_cast<size_t>(-1);
+  // heap order: infinite distance first, then the oldest relevant stamp
+  bool Before(size_t a, size_t b) const;
+  void SiftUp(size_t i);
+  void SiftDown(size_t i);
+  void HeapRemove(size_t i);
+  void Swap(size_t i, size_t j);
+
+  size_t k;
+  uint64_t correlated_period;
+  uint64_t clock;
+  std::function<page_id_t(const T &)> key;
+  // per slot; slots are handed out on first sight and never given back
+  SlotMap<T> slots;                     // value -> its slot
+  std::vector<T> values;                // slot -> value
+  std::vector<page_id_t> keys;          // page id the slot had when last seen
+  std::vector<uint64_t> history;        // k stamps per slot, latest first
+  std::vector<size_t> accesses;         // stamps in use, at most k
+  std::vector<size_t> position;         // index in heap or NOT_IN_HEAP
+  std::vector<size_t> heap;             // evictable slots
+  mutable std::mutex latch;
+};
+
+} // namespace scudb
@@ -2,33 +2,63 @@
  * LRU implementation
  */
 #include "buffer/lru_replacer.h"
+#include "buffer/frame_id.h"
 #include "page/page.h"
 
 namespace scudb {
 
-template <typename T> LRUReplacer<T>::LRUReplacer() {}
+template <typename T> const size_t LRUReplacer<T>::HEAD;
+
+template <typename T>
+LRUReplacer<T>::LRUReplacer()
+    : values(1), prev(1, HEAD), next(1, HEAD), size(0) {}
 
 template <typename T> LRUReplacer<T>::~LRUReplacer() {}
 
+template <typename T> void LRUReplacer<T>::Unlink(size_t slot) {
+  next[prev[slot]] = next[slot];
+  prev[next[slot]] = prev[slot];
+  size--;
+}
+
+/*
+ * slot's value left the list: the slot goes to the next new value
+ */
+template <typename T> void LRUReplacer<T>::Release(size_t slot) {
+  slots.Remove(values[slot]);
+  freeSlots.push_back(slot);
+}
+
+template <typename T> void LRUReplacer<T>::PushFront(size_t slot) {
+  prev[slot] = HEAD;
+  next[slot] = next[HEAD];
+  prev[next[HEAD]] = slot;
+  next[HEAD] = slot;
+  size++;
+}
 
 /*
  * Insert value into LRU
  */
 template <typename T> void LRUReplacer<T>::Insert(const T &value) {
   std::lock_guard<std::mutex> lck(latch);
-// situation:linked list already had value
-  std::shared_ptr<CacheNode> temp;
-  //find() will return iterator pointing to the end of lrumap if not found
-  if(lrumap.find(value) != lrumap.end()){ 
-    temp = lrumap[value];
-    //remove the node from its current position
-    lrulist.remove(temp);
+  size_t slot;
+  if(slots.Find(value, slot)){
+    // situation:linked list already had value, move it to the front
+    Unlink(slot);
+  }else if(!freeSlots.empty()){
+    slot = freeSlots.back();
+    freeSlots.pop_back();
+    slots.Add(value, slot);
+    values[slot] = value;
   }else{
-    temp = std::make_shared<CacheNode>(value);
+    slot = values.size();
+    slots.Add(value, slot);
+    values.push_back(value);
+    prev.push_back(HEAD);
+    next.push_back(HEAD);
   }
-  lrulist.push_front(temp);
-  lrumap[value] = temp;
-  return;
+  PushFront(slot);
 }
 
 /* If LRU is non-empty, pop the head member from LRU to argument "value", and
@@ -36,16 +66,14 @@ template <typename T> void LRUReplacer<T>::Insert(const T &value) {
  */
 template <typename T> bool LRUReplacer<T>::Victim(T &value) {
   std::lock_guard<std::mutex> lck(latch);
-  if(lrumap.empty()){
+  if(size == 0){
     return false;
   }
-  // remove least rencently used
-  std::shared_ptr<CacheNode> temp;
-  // choose tail of list
-  temp = lrulist.back();
-  lrumap.erase(temp->value);
-  lrulist.pop_back();
-  value = temp->value;
+  // remove least rencently used: tail of list
+  size_t slot = prev[HEAD];
+  Unlink(slot);
+  Release(slot);
+  value = values[slot];
   return true;
 }
 
@@ -55,20 +83,22 @@ template <typename T> bool LRUReplacer<T>::Victim(T &value) {
  */
 template <typename T> bool LRUReplacer<T>::Erase(const T &value) {
   std::lock_guard<std::mutex> lck(latch);
-  if(lrumap.find(value) != lrumap.end()){
-    std::shared_ptr<CacheNode> temp = lrumap[value];
-    lrulist.remove(temp);
+  size_t slot;
+  if(!slots.Find(value, slot)){
+    return false;
   }
-  return lrumap.erase(value);
+  Unlink(slot);
+  Release(slot);
+  return true;
 }
 
 template <typename T> size_t LRUReplacer<T>::Size() {
   std::lock_guard<std::mutex> lck(latch);
-  return lrumap.size();
+  return size;
 }
 
 template class LRUReplacer<Page *>;
-// test only
-template class LRUReplacer<int>;
+// frame ids of the buffer pool, also what the tests use
+template class LRUReplacer<frame_id_t>;
 
 } // namespace scudb
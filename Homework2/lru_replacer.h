@@ -9,25 +9,25 @@
 
 #pragma once
 
-#include <memory>
-#include <unordered_map>
 #include <mutex>
-#include <list>
-#include <iterator>
+#include <vector>
 #include "buffer/replacer.h"
+#include "buffer/slot_map.h"
 #include "hash/extendible_hash.h"
 
 using namespace std;
 namespace scudb {
 
+/*
+ * Every value in the list has a slot; the LRU list is threaded through the
+ * prev/next arrays of the slots, with slot 0 as the sentinel (next of the
+ * sentinel is the most recently used value, prev the least recently used).
+ * Victim and Erase give the slot back for the next new value, so the arrays
+ * never hold more slots than the list once held values, whatever values are
+ * inserted. With the frames of a pool Insert, Victim and Erase are O(1) and
+ * do not allocate once every frame was seen.
+ */
 template <typename T> class LRUReplacer : public Replacer<T> {
-struct CacheNode{
-  /* data */
-  CacheNode() {};
-  CacheNode(T v) : value(v) {};
-  T value;
-};
-
 public:
 
   LRUReplacer();
@@ -43,9 +43,18 @@ public:
   size_t Size();
 
 private:
+  static const size_t HEAD = 0;
+  void Unlink(size_t slot);
+  void PushFront(size_t slot);
+  void Release(size_t slot);
+
   // add your member variables here
-  std::list<std::shared_ptr<CacheNode>> lrulist;
-  std::unordered_map<T, std::shared_ptr<CacheNode>> lrumap;
+  SlotMap<T> slots;                     // value -> its slot
+  std::vector<T> values;                // slot -> value
+  std::vector<size_t> prev;
+  std::vector<size_t> next;
+  std::vector<size_t> freeSlots;        // given back by Victim and Erase
+  size_t size;
   // mutable make tablelatch can use in const
   mutable std::mutex latch;
 };
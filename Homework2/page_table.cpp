@@ -0,0 +1,95 @@
+#include <cassert>
+
+#include "hash/page_table.h"
+
+namespace scudb {
+
+/*
+ * Four slots per frame, rounded up to a power of two, so even with every
+ * frame in the middle of a write-back the table is at most half full.
+ */
+PageTable::PageTable(size_t max_frames) : size(0) {
+  size_t capacity = 4;
+  int bits = 2;
+  while (capacity < 4 * max_frames) {
+    capacity <<= 1;
+    bits++;
+  }
+  slots.assign(capacity, Slot{INVALID_PAGE_ID, nullptr});
+  mask = capacity - 1;
+  shift = 64 - bits;
+}
+
+/*
+ * Fibonacci hashing: the top bits of the product depend on every bit of the
+ * page id. The ids of one instance all have the same remainder modulo the
+ * number of instances, so their low bits alone would pile up in a few slots.
+ */
+size_t PageTable::Home(page_id_t page_id) const {
+  uint64_t x = static_cast<uint32_t>(page_id) * 0x9E3779B97F4A7C15ULL;
+  return static_cast<size_t>(x >> shift);
+}
+
+bool PageTable::Find(const page_id_t &page_id, Page *&page) {
+  for (size_t i = Home(page_id);; i = (i + 1) & mask) {
+    const Slot &slot = slots[i];
+    // empty first: INVALID_PAGE_ID itself is never in the table
+    if (slot.pageId == INVALID_PAGE_ID) {
+      return false;
+    }
+    if (slot.pageId == page_id) {
+      page = slot.page;
+      return true;
+    }
+  }
+}
+
+/*
+ * Backward shift deletion: walk the run after the freed slot and move back
+ * every entry whose home is not between the hole and its current slot, so
+ * no entry ends up behind an empty slot on its probe path.
+ */
+bool PageTable::Remove(const page_id_t &page_id) {
+  size_t hole = Home(page_id);
+  while (true) {
+    if (slots[hole].pageId == INVALID_PAGE_ID) {
+      return false;
+    }
+    if (slots[hole].pageId == page_id) {
+      break;
+    }
+    hole = (hole + 1) & mask;
+  }
+  for (size_t i = (hole + 1) & mask; slots[i].pageId != INVALID_PAGE_ID;
+       i = (i + 1) & mask) {
+    size_t home = Home(slots[i].pageId);
+    if (((i - home) & mask) >= ((i - hole) & mask)) {
+      slots[hole] = slots[i];
+      hole = i;
+    }
+  }
+  slots[hole] = Slot{INVALID_PAGE_ID, nullptr};
+  size--;
+  return true;
+}
+
+/*
+ * Overwrites the frame of a page id already in the table.
+ */
+void PageTable::Insert(const page_id_t &page_id, Page *const &page) {
+  // the empty slot marker, would cut the probe runs it lands in
+  assert(page_id != INVALID_PAGE_ID);
+  size_t i = Home(page_id);
+  while (slots[i].pageId != INVALID_PAGE_ID) {
+    if (slots[i].pageId == page_id) {
+      slots[i].page = page;
+      return;
+    }
+    i = (i + 1) & mask;
+  }
+  assert(size < mask); // keep an empty slot so that every probe ends
+  slots[i] = Slot{page_id, page};
+  size++;
+}
+
+} // namespace scudb
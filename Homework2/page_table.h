@@ -0,0 +1,53 @@
+/*
+ * page_table.h : fixed-capacity page table of a buffer pool instance
+ *
+ * Functionality: maps a page id to the frame holding it, like
+ * ExtendibleHash<page_id_t, Page *>, but for a population known up front:
+ * an instance never holds more entries than twice its frames (a frame being
+ * written back is reachable by its old and its new page id). So the table is
+ * one power-of-two array of slots allocated in the constructor and searched
+ * by linear probing, a quarter full in normal use and never more than
+ * half. A lookup usually touches one cache line. Remove shifts the following
+ * entries back instead of leaving tombstones, so lookups never get slower
+ * with churn.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
+
+#include "common/config.h"
+#include "hash/hash_table.h"
+#include "page/page.h"
+
+namespace scudb {
+
+class PageTable final : public HashTable<page_id_t, Page *> {
+public:
+  // max_frames: the most frames the owning instance can ever have
+  explicit PageTable(size_t max_frames);
+
+  bool Find(const page_id_t &page_id, Page *&page) override;
+  bool Remove(const page_id_t &page_id) override;
+  void Insert(const page_id_t &page_id, Page *const &page) override;
+
+  size_t Size() const { return size; }
+
+private:
+  // pageId is INVALID_PAGE_ID in an empty slot
+  struct Slot {
+    page_id_t pageId;
+    Page *page;
+  };
+  // slot where the search for page_id starts
+  size_t Home(page_id_t page_id) const;
+
+  std::vector<Slot> slots;
+  size_t mask;  // slots.size() - 1
+  int shift;    // 64 - log2(slots.size()), see Home
+  size_t size;
+};
+
+} // namespace scudb
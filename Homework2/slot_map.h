@@ -0,0 +1,94 @@
+/**
+ * slot_map.h
+ *
+ * Functionality: maps the values a replacer is given to the slot (index into
+ * its per-value arrays) they got when first seen. Values of an integral
+ * type, such as the frame ids of the buffer pool, are used as an index into
+ * a flat array; any other type goes through a hash table.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+namespace scudb {
+
+template <typename T, bool Dense = std::is_integral<T>::value> class SlotMap;
+
+template <typename T> class SlotMap<T, false> {
+public:
+  bool Find(const T &value, size_t &slot) const {
+    auto it = slots.find(value);
+    if (it == slots.end()) {
+      return false;
+    }
+    slot = it->second;
+    return true;
+  }
+  void Add(const T &value, size_t slot) { slots.emplace(value, slot); }
+  void Remove(const T &value) { slots.erase(value); }
+
+private:
+  std::unordered_map<T, size_t> slots;
+};
+
+/*
+ * Values are an index into a flat array as long as the array stays within a
+ * few times the number of values held; a negative value, or one far past
+ * the others, goes to a hash table instead of growing the array to it.
+ */
+template <typename T> class SlotMap<T, true> {
+public:
+  bool Find(const T &value, size_t &slot) const {
+    size_t index = static_cast<size_t>(value);
+    if (index < slots.size() && slots[index] != 0) {
+      slot = slots[index] - 1;
+      return true;
+    }
+    if (sparse.empty()) {
+      return false;
+    }
+    auto it = sparse.find(value);
+    if (it == sparse.end()) {
+      return false;
+    }
+    slot = it->second;
+    return true;
+  }
+  void Add(const T &value, size_t slot) {
+    // negative values wrap around to indexes past any limit
+    size_t index = static_cast<size_t>(value);
+    if (index >= slots.size()) {
+      if (index >= DENSE_SLACK + 2 * count) {
+        sparse.emplace(value, slot);
+        count++;
+        return;
+      }
+      slots.resize(index + 1, 0);
+    }
+    slots[index] = slot + 1;
+    count++;
+  }
+  void Remove(const T &value) {
+    size_t index = static_cast<size_t>(value);
+    if (index < slots.size() && slots[index] != 0) {
+      slots[index] = 0;
+      count--;
+    } else if (sparse.erase(value) != 0) {
+      count--;
+    }
+  }
+
+private:
+  static const size_t DENSE_SLACK = 1024;
+
+  std::vector<size_t> slots;  // slot + 1 by value, 0: not seen yet
+  std::unordered_map<T, size_t> sparse;  // values left out of slots
+  size_t count = 0;  // values held
+};
+
+} // namespace scudb
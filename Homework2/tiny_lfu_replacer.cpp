@@ -0,0 +1,171 @@
+/**
+ * W-TinyLFU implementation
+ */
+#include <algorithm>
+
+#include "buffer/tiny_lfu_replacer.h"
+#include "buffer/frame_id.h"
+#include "page/page.h"
+
+namespace scudb {
+
+template <typename T> const size_t TinyLFUReplacer<T>::MIN_WINDOW;
+
+template <typename T>
+TinyLFUReplacer<T>::TinyLFUReplacer(size_t capacity,
+                                    std::function<page_id_t(const T &)> key)
+    : windowSize(std::max(capacity / 100, MIN_WINDOW)), key(key),
+      sketch(capacity, 10 * std::max<size_t>(capacity, 1)), values(2),
+      keys(2, INVALID_PAGE_ID), segment(2, NONE), linked(2, false),
+      evictable(0) {
+  // empty circular lists: WINDOW sentinel is slot 0, MAIN sentinel slot 1
+  prev = {0, 1};
+  next = {0, 1};
+  count[NONE] = count[WINDOW] = count[MAIN] = 0;
+}
+
+template <typename T> TinyLFUReplacer<T>::~TinyLFUReplacer() {}
+
+/*
+ * Put slot at the most recent end of the list of segment
+ */
+template <typename T>
+void TinyLFUReplacer<T>::Link(size_t slot, Segment seg) {
+  size_t head = seg == WINDOW ? 0 : 1;
+  if(segment[slot] != seg){
+    if(segment[slot] != NONE){
+      count[segment[slot]]--;
+    }
+    count[seg]++;
+    segment[slot] = seg;
+  }
+  prev[slot] = head;
+  next[slot] = next[head];
+  prev[next[head]] = slot;
+  next[head] = slot;
+  linked[slot] = true;
+  evictable++;
+}
+
+template <typename T> void TinyLFUReplacer<T>::Unlink(size_t slot) {
+  next[prev[slot]] = next[slot];
+  prev[next[slot]] = prev[slot];
+  linked[slot] = false;
+  evictable--;
+}
+
+template <typename T> size_t TinyLFUReplacer<T>::Oldest(Segment seg) const {
+  size_t head = seg == WINDOW ? 0 : 1;
+  return prev[head] == head ? 0 : prev[head];
+}
+
+/*
+ * An access to value. Seen before with the same page id: a hit, it moves to
+ * the most recent end of its segment. Otherwise it enters the window, and a
+ * window grown past its size hands its least recent values to MAIN.
+ */
+template <typename T> void TinyLFUReplacer<T>::Insert(const T &value) {
+  std::lock_guard<std::mutex> lck(latch);
+  page_id_t page_id = key(value);
+  sketch.Increment(static_cast<uint64_t>(page_id));
+  size_t slot;
+  if(!slots.Find(value, slot)){
+    slot = values.size();
+    slots.Add(value, slot);
+    values.push_back(value);
+    keys.push_back(INVALID_PAGE_ID);
+    segment.push_back(NONE);
+    linked.push_back(false);
+    prev.push_back(slot);
+    next.push_back(slot);
+  }
+  if(linked[slot]){
+    Unlink(slot);
+  }
+  if(segment[slot] != NONE && keys[slot] == page_id){
+    Link(slot, segment[slot]);
+    return;
+  }
+  // a frame reused without Victim forgets its old page
+  keys[slot] = page_id;
+  Link(slot, WINDOW);
+  size_t oldest;
+  while(count[WINDOW] > windowSize && (oldest = Oldest(WINDOW)) != slot &&
+        oldest != 0){
+    Unlink(oldest);
+    Link(oldest, MAIN);
+  }
+}
+
+/*
+ * Make room for a value about to enter the window. While the window is full
+ * its least recent value competes with the least recent one of MAIN: the
+ * one whose page was used less often recently is evicted, a winning window
+ * value moves to MAIN. Otherwise MAIN gives up its least recent value.
+ * Either segment gives up its own if the other has nothing evictable.
+ */
+template <typename T> bool TinyLFUReplacer<T>::Victim(T &value) {
+  std::lock_guard<std::mutex> lck(latch);
+  if(evictable == 0){
+    return false;
+  }
+  size_t candidate = Oldest(WINDOW), victim = Oldest(MAIN);
+  size_t slot;
+  if(victim == 0){
+    slot = candidate;
+  }else if(candidate == 0 || count[WINDOW] < windowSize){
+    slot = victim;
+  }else if(sketch.Estimate(static_cast<uint64_t>(keys[candidate])) >
+           sketch.Estimate(static_cast<uint64_t>(keys[victim]))){
+    Unlink(candidate);
+    Link(candidate, MAIN);
+    slot = victim;
+  }else{
+    slot = candidate;
+  }
+  Unlink(slot);
+  count[segment[slot]]--;
+  segment[slot] = NONE;
+  keys[slot] = INVALID_PAGE_ID;
+  value = values[slot];
+  return true;
+}
+
+/*
+ * value got pinned: off its list until the next Insert
+ */
+template <typename T> bool TinyLFUReplacer<T>::Erase(const T &value) {
+  std::lock_guard<std::mutex> lck(latch);
+  size_t slot;
+  if(!slots.Find(value, slot) || !linked[slot]){
+    return false;
+  }
+  Unlink(slot);
+  return true;
+}
+
+template <typename T> size_t TinyLFUReplacer<T>::Size() {
+  std::lock_guard<std::mutex> lck(latch);
+  return evictable;
+}
+
+/*
+ * Resize the window and the sketch; a window now over its size hands its
+ * least recent values to MAIN as Insert does.
+ */
+template <typename T> void TinyLFUReplacer<T>::SetCapacity(size_t capacity) {
+  std::lock_guard<std::mutex> lck(latch);
+  windowSize = std::max(capacity / 100, MIN_WINDOW);
+  sketch.Resize(capacity, 10 * std::max<size_t>(capacity, 1));
+  size_t oldest;
+  while(count[WINDOW] > windowSize && (oldest = Oldest(WINDOW)) != 0){
+    Unlink(oldest);
+    Link(oldest, MAIN);
+  }
+}
+
+template class TinyLFUReplacer<Page *>;
+// frame ids of the buffer pool, also what the tests use
+template class TinyLFUReplacer<frame_id_t>;
+
+} // namespace scudb
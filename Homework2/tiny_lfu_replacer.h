@@ -0,0 +1,81 @@
+/**
+ * tiny_lfu_replacer.h
+ *
+ * Functionality: W-TinyLFU. Newly loaded values enter a small LRU window
+ * (1% of the frames, at least MIN_WINDOW); values pushed out of the window
+ * join the main LRU segment. When a frame is needed while the window is
+ * full, the least recent value of the window is only admitted to the main
+ * segment if its page was accessed more often recently than the main
+ * segment's least recent page, which is then evicted instead. Access
+ * frequencies are estimated by a count-min sketch that is halved
+ * periodically, so a long scan (pages touched once) passes through the
+ * window without flushing the frequently used pages out of the main
+ * segment.
+ *
+ * Mapping onto the Replacer interface as in ARCReplacer: Insert (the unpin
+ * ending a use) is the access, Erase (a page that got pinned since it was
+ * inserted) takes the value off its list until the next Insert, and a value whose
+ * page id changed since it was last seen starts over in the window.
+ */
+
+#pragma once
+
+#include <functional>
+#include <mutex>
+#include <vector>
+#include "buffer/replacer.h"
+#include "buffer/slot_map.h"
+#include "common/config.h"
+#include "hash/count_min_sketch.h"
+
+using namespace std;
+namespace scudb {
+
+template <typename T> class TinyLFUReplacer : public Replacer<T> {
+public:
+  // capacity: number of frames the replacer serves, key: the page id a
+  // value holds at the time of the call
+  TinyLFUReplacer(size_t capacity, std::function<page_id_t(const T &)> key);
+
+  ~TinyLFUReplacer();
+
+  void Insert(const T &value);
+
+  bool Victim(T &value);
+
+  bool Erase(const T &value);
+
+  size_t Size();
+
+  // the number of frames served changed (BufferPoolManager::Resize)
+  void SetCapacity(size_t capacity);
+
+private:
+  enum Segment { NONE = 0, WINDOW, MAIN };
+  // pages read ahead wait in the window until the scan reaches them, a
+  // smaller window evicts them before their first use
+  static const size_t MIN_WINDOW = 16;
+
+  void Link(size_t slot, Segment segment);
+  void Unlink(size_t slot);
+  // least recent evictable slot of segment, 0 if there is none
+  size_t Oldest(Segment segment) const;
+
+  size_t windowSize;
+  std::function<page_id_t(const T &)> key;
+  CountMinSketch sketch;
+  // slots 0 and 1 are the sentinels of the WINDOW and MAIN lists (next:
+  // most recent, prev: least recent); slots are never given back
+  SlotMap<T> slots;
+  std::vector<T> values;
+  std::vector<page_id_t> keys;     // page id the slot had when last seen
+  std::vector<Segment> segment;    // segment the slot belongs to
+  std::vector<bool> linked;        // on its list, i.e. evictable
+  std::vector<size_t> prev;
+  std::vector<size_t> next;
+  size_t count[3];                 // values per segment, pinned ones included
+  size_t evictable;
+  mutable std::mutex latch;
+};
+
+} // namespace scudb
@@ -359,11 +359,11 @@ bool BPLUSTREE_TYPE::AdjustRoot(BPlusTreePage *old_root_node) {
  * @return : index iterator
  */
 INDEX_TEMPLATE_ARGUMENTS
-INDEXITERATOR_TYPE BPLUSTREE_TYPE::Begin() {
+INDEXITERATOR_TYPE BPLUSTREE_TYPE::Begin(BufferAccessStrategy *strategy) {
   KeyType useless;
   auto start_leaf = FindLeafPage(useless, true);
   TryUnlockRootPageId(false);
-  return INDEXITERATOR_TYPE(start_leaf, 0, buffer_pool_manager_);
+  return INDEXITERATOR_TYPE(start_leaf, 0, buffer_pool_manager_, strategy);
 }
 
 /*
@@ -372,14 +372,15 @@ INDEXITERATOR_TYPE BPLUSTREE_TYPE::Begin() {
  * @return : index iterator
  */
 INDEX_TEMPLATE_ARGUMENTS
-INDEXITERATOR_TYPE BPLUSTREE_TYPE::Begin(const KeyType &key) {
+INDEXITERATOR_TYPE BPLUSTREE_TYPE::Begin(const KeyType &key,
+                                         BufferAccessStrategy *strategy) {
   auto start_leaf = FindLeafPage(key);
   TryUnlockRootPageId(false);
   if (start_leaf == nullptr) {
-    return INDEXITERATOR_TYPE(start_leaf, 0, buffer_pool_manager_);
+    return INDEXITERATOR_TYPE(start_leaf, 0, buffer_pool_manager_, strategy);
   }
   int idx = start_leaf->KeyIndex(key,comparator_);
-  return INDEXITERATOR_TYPE(start_leaf, idx, buffer_pool_manager_);
+  return INDEXITERATOR_TYPE(start_leaf, idx, buffer_pool_manager_, strategy);
 }
 
 /*****************************************************************************
@@ -442,10 +443,14 @@ void BPLUSTREE_TYPE::FreePagesInTransaction(bool exclusive, Transaction *transac
     buffer_pool_manager_->UnpinPage(cur,false);
     return;
   }
+  std::vector<page_id_t> pageIds;
   for (Page *page : *transaction->GetPageSet()) {
-    int curPid = page->GetPageId();
+    pageIds.push_back(page->GetPageId());
     Unlock(exclusive,page);
-    buffer_pool_manager_->UnpinPage(curPid,exclusive);
+  }
+  // unpin them all at once, then drop the pages emptied by this operation
+  buffer_pool_manager_->UnpinPages(pageIds,exclusive);
+  for (page_id_t curPid : pageIds) {
     if (transaction->GetDeletedPageSet()->find(curPid) != transaction->GetDeletedPageSet()->end()) {
       buffer_pool_manager_->DeletePage(curPid);
       transaction->GetDeletedPageSet()->erase(curPid);
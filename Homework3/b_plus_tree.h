@@ -44,9 +44,11 @@ public:
   bool GetValue(const KeyType &key, std::vector<ValueType> &result,
                 Transaction *transaction = nullptr);
 
-  // index iterator
-  INDEXITERATOR_TYPE Begin();
-  INDEXITERATOR_TYPE Begin(const KeyType &key);
+  // index iterator, large scans should pass a BufferAccessStrategy so that
+  // their leaves do not push the working set out of the buffer pool
+  INDEXITERATOR_TYPE Begin(BufferAccessStrategy *strategy = nullptr);
+  INDEXITERATOR_TYPE Begin(const KeyType &key,
+                           BufferAccessStrategy *strategy = nullptr);
 
   // Print this B+ tree to stdout using a simple command-line
   std::string ToString(bool verbose = false);
@@ -1,6 +1,7 @@
 /**
  * b_plus_tree_internal_page.cpp
  */
+#include <algorithm>
 #include <iostream>
 #include <sstream>
 
@@ -8,6 +9,9 @@
 #include "page/b_plus_tree_internal_page.h"
 
 namespace scudb {
+// children SetChildrenParent pins at a time
+static const size_t CHILD_BATCH = 16;
+
 /*****************************************************************************
  * HELPER METHODS AND UTILITIES
  *****************************************************************************/
@@ -140,18 +144,57 @@ void B_PLUS_TREE_INTERNAL_PAGE_TYPE::MoveHalfTo(
       assert(GetSize() == n);
       int copyIndex = n/2;
       page_id_t recipPageId = recipient->GetPageId();
+      std::vector<page_id_t> children;
       for(int i = copyIndex; i < n; i++){
         recipient->array[i - copyIndex].first = array[i].first;
         recipient->array[i - copyIndex].second = array[i].second;
-        Page *childPage = buffer_pool_manager->FetchPage(array[i].second);
-        BPlusTreePage *childTreePage = reinterpret_cast<BPlusTreePage *>(childPage->GetData());
-        childTreePage->SetParentPageId(recipPageId);
-        buffer_pool_manager->UnpinPage(array[i].second, true);
+        children.push_back(array[i].second);
       }
       SetSize(copyIndex);
       recipient->SetSize(n - copyIndex);
+      SetChildrenParent(children, recipPageId, buffer_pool_manager);
     }
 
+/*
+ * Point the parent page id of every child in children to parent_id. The
+ * children are pinned in batches of CHILD_BATCH: a whole node's worth could
+ * need more frames than the pool has. A child that found no frame while its
+ * batch was pinned is fetched on its own once the batch is unpinned.
+ */
+INDEX_TEMPLATE_ARGUMENTS
+void B_PLUS_TREE_INTERNAL_PAGE_TYPE::SetChildrenParent(
+    const std::vector<page_id_t> &children, page_id_t parent_id,
+    BufferPoolManager *buffer_pool_manager) {
+  for (size_t start = 0; start < children.size(); start += CHILD_BATCH) {
+    size_t end = std::min(children.size(), start + CHILD_BATCH);
+    std::vector<page_id_t> batch(children.begin() + start,
+                                 children.begin() + end);
+    std::vector<Page *> pages = buffer_pool_manager->FetchPages(batch);
+    std::vector<page_id_t> pinned, missed;
+    for (size_t i = 0; i < pages.size(); i++) {
+      if (pages[i] == nullptr) {
+        missed.push_back(batch[i]);
+        continue;
+      }
+      BPlusTreePage *child =
+          reinterpret_cast<BPlusTreePage *>(pages[i]->GetData());
+      child->SetParentPageId(parent_id);
+      pinned.push_back(batch[i]);
+    }
+    buffer_pool_manager->UnpinPages(pinned, true);
+    for (page_id_t child_id : missed) {
+      Page *page = buffer_pool_manager->FetchPage(child_id);
+      if (page == nullptr) {
+        throw Exception(EXCEPTION_TYPE_INDEX,
+                        "all page are pinned while moving children");
+      }
+      BPlusTreePage *child = reinterpret_cast<BPlusTreePage *>(page->GetData());
+      child->SetParentPageId(parent_id);
+      buffer_pool_manager->UnpinPage(child_id, true);
+    }
+  }
+}
+
 INDEX_TEMPLATE_ARGUMENTS
 void B_PLUS_TREE_INTERNAL_PAGE_TYPE::CopyHalfFrom(
     MappingType *items, int size, BufferPoolManager *buffer_pool_manager) {}
@@ -204,14 +247,13 @@ void B_PLUS_TREE_INTERNAL_PAGE_TYPE::MoveAllTo(
 
       SetKeyAt(0, parent->KeyAt(index_in_parent));
       buffer_pool_manager->UnpinPage(parent->GetPageId(), false);
+      std::vector<page_id_t> children;
       for(int i = 0; i < GetSize(); i++){
         recipient->array[start + i].first = array[i].first;
         recipient->array[start + i].second = array[i].second;
-        Page *childPage = buffer_pool_manager->FetchPage(array[i].second);
-        BPlusTreePage *childTreePage = reinterpret_cast<BPlusTreePage *>(childPage->GetData());
-        childTreePage->SetParentPageId(recipPageId);
-        buffer_pool_manager->UnpinPage(array[i].second,true);
+        children.push_back(array[i].second);
       }
+      SetChildrenParent(children, recipPageId, buffer_pool_manager);
       
       recipient->SetSize(start + GetSize());
       assert(recipient->GetSize() <= GetMaxSize());
@@ -305,11 +347,23 @@ INDEX_TEMPLATE_ARGUMENTS
 void B_PLUS_TREE_INTERNAL_PAGE_TYPE::QueueUpChildren(
     std::queue<BPlusTreePage *> *queue,
     BufferPoolManager *buffer_pool_manager) {
+  std::vector<page_id_t> children;
   for (int i = 0; i < GetSize(); i++) {
-    auto *page = buffer_pool_manager->FetchPage(array[i].second);
-    if (page == nullptr)
+    children.push_back(array[i].second);
+  }
+  std::vector<Page *> pages = buffer_pool_manager->FetchPages(children);
+  for (size_t i = 0; i < pages.size(); i++) {
+    if (pages[i] == nullptr) {
+      // give back what was pinned before failing
+      for (size_t j = 0; j < pages.size(); j++) {
+        if (pages[j] != nullptr)
+          buffer_pool_manager->UnpinPage(children[j], false);
+      }
       throw Exception(EXCEPTION_TYPE_INDEX,
                       "all page are pinned while printing");
+    }
+  }
+  for (Page *page : pages) {
     BPlusTreePage *node =
         reinterpret_cast<BPlusTreePage *>(page->GetData());
     queue->push(node);
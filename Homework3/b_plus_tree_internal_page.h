@@ -17,6 +17,7 @@
 #pragma once
 
 #include <queue>
+#include <vector>
 
 #include "page/b_plus_tree_page.h"
 
@@ -69,6 +70,9 @@ private:
                     BufferPoolManager *buffer_pool_manager);
   void CopyFirstFrom(const MappingType &pair, int parent_index,
                      BufferPoolManager *buffer_pool_manager);
+  void SetChildrenParent(const std::vector<page_id_t> &children,
+                         page_id_t parent_id,
+                         BufferPoolManager *buffer_pool_manager);
   MappingType array[0];
 };
 } // namespace scudb
@@ -12,8 +12,11 @@ namespace scudb {
  * set your own input parameters
  */
 INDEX_TEMPLATE_ARGUMENTS
-INDEXITERATOR_TYPE::IndexIterator(B_PLUS_TREE_LEAF_PAGE_TYPE *leaf_page, int index, BufferPoolManager *bufferPoolManager) 
-: Index(index),leafPage(leaf_page), bufferPoolManager(bufferPoolManager){}
+INDEXITERATOR_TYPE::IndexIterator(B_PLUS_TREE_LEAF_PAGE_TYPE *leaf_page, int index, BufferPoolManager *bufferPoolManager,
+                                  BufferAccessStrategy *strategy)
+: Index(index),leafPage(leaf_page), bufferPoolManager(bufferPoolManager),
+  aheadLeft(0), aheadParent(INVALID_PAGE_ID), aheadLast(INVALID_PAGE_ID),
+  aheadAtEnd(false), strategy(strategy){}
 
 INDEX_TEMPLATE_ARGUMENTS
 INDEXITERATOR_TYPE::~IndexIterator() {
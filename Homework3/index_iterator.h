@@ -3,6 +3,9 @@
  * For range scan of b+ tree
  */
 #pragma once
+#include <vector>
+
+#include "page/b_plus_tree_internal_page.h"
 #include "page/b_plus_tree_leaf_page.h"
 
 namespace scudb {
@@ -14,7 +17,8 @@ INDEX_TEMPLATE_ARGUMENTS
 class IndexIterator {
 public:
   // you may define your own constructor based on your member variables
-  IndexIterator(B_PLUS_TREE_LEAF_PAGE_TYPE *leaf_page, int index, BufferPoolManager *bufferPoolManager);
+  IndexIterator(B_PLUS_TREE_LEAF_PAGE_TYPE *leaf_page, int index, BufferPoolManager *bufferPoolManager,
+                BufferAccessStrategy *strategy = nullptr);
   ~IndexIterator();
 
   bool isEnd(){
@@ -29,11 +33,13 @@ public:
     Index++;
     if (Index >= leafPage->GetSize()) {
       page_id_t next = leafPage->GetNextPageId();
+      page_id_t parent = leafPage->GetParentPageId();
       UnlockAndUnPin();
       if (next == INVALID_PAGE_ID) {
         leafPage = nullptr;
       } else {
-        Page *page = bufferPoolManager->FetchPage(next);
+        ReadAhead(parent, next);
+        Page *page = bufferPoolManager->FetchPage(next, strategy);
         page->RLatch();
         leafPage = reinterpret_cast<B_PLUS_TREE_LEAF_PAGE_TYPE *>(page->GetData());
         Index = 0;
@@ -43,6 +49,124 @@ public:
   }
 
 private:
+  // number of leaves the scan asks the buffer pool to load ahead of itself
+  static const int READ_AHEAD_LEAVES = 8;
+
+  /*
+   * Crossing a leaf boundary means the scan is sequential, so ask the buffer
+   * pool to load the leaves that follow, and ask for the next batch once half
+   * of them have been reached. A batch goes on after the last leaf asked for
+   * (after next when none is ahead) and continues with the first children of
+   * the next internal pages when its parent runs out; the internal pages are
+   * fetched only while a batch is being put together.
+   * Pages are latched one at a time and only after the current leaf was
+   * released, so the top-down latch order of the tree is kept. A stale parent
+   * only costs a useless hint. Scans with a strategy read no ahead, the hinted
+   * pages would be loaded into the main pool rather than into the ring.
+   */
+  void ReadAhead(page_id_t parent, page_id_t next) {
+    if (aheadLeft > 0) {
+      aheadLeft--;
+    } else {
+      aheadParent = parent;
+      aheadLast = next;
+    }
+    if (strategy != nullptr || aheadAtEnd ||
+        aheadLeft > READ_AHEAD_LEAVES / 2 || aheadParent == INVALID_PAGE_ID) {
+      return;
+    }
+    std::vector<page_id_t> leaves;
+    page_id_t grand;
+    if (!Children(aheadParent, aheadLast, READ_AHEAD_LEAVES, leaves, grand)) {
+      aheadLeft = 0; // the tree changed under the batch, start over from next
+      return;
+    }
+    while (static_cast<int>(leaves.size()) < READ_AHEAD_LEAVES) {
+      page_id_t sibling;
+      if (!NextSibling(aheadParent, grand, sibling)) {
+        break;
+      }
+      if (sibling == INVALID_PAGE_ID) {
+        aheadAtEnd = true;
+        break;
+      }
+      size_t before = leaves.size();
+      if (!Children(sibling, INVALID_PAGE_ID, READ_AHEAD_LEAVES, leaves, grand) ||
+          leaves.size() == before) {
+        break;
+      }
+      aheadParent = sibling;
+    }
+    if (!leaves.empty()) {
+      bufferPoolManager->PrefetchPages(leaves);
+      aheadLeft += static_cast<int>(leaves.size());
+      aheadLast = leaves.back();
+    }
+  }
+
+  /*
+   * Append the children of internal page page_id that come after child (all
+   * of them if child is INVALID_PAGE_ID) to out while it holds less than
+   * limit ids, and set parent to the parent of the page. Returns false if the
+   * page cannot be fetched, is no internal page or does not hold child.
+   */
+  bool Children(page_id_t page_id, page_id_t child, size_t limit,
+                std::vector<page_id_t> &out, page_id_t &parent) {
+    Page *page = bufferPoolManager->FetchPage(page_id);
+    if (page == nullptr) {
+      return false;
+    }
+    page->RLatch();
+    auto *internal = reinterpret_cast<
+        BPlusTreeInternalPage<KeyType, page_id_t, KeyComparator> *>(page->GetData());
+    bool found = !internal->IsLeafPage();
+    int index = 0;
+    if (found && child != INVALID_PAGE_ID) {
+      index = internal->ValueIndex(child) + 1;
+      found = index > 0;
+    }
+    if (found) {
+      parent = internal->GetParentPageId();
+      for (int i = index; i < internal->GetSize() && out.size() < limit; i++) {
+        out.push_back(internal->ValueAt(i));
+      }
+    }
+    page->RUnlatch();
+    bufferPoolManager->UnpinPage(page_id, false);
+    return found;
+  }
+
+  /*
+   * Set sibling to the internal page right of page_id on its level, whose
+   * parent is parent, or to INVALID_PAGE_ID at the right edge of the tree.
+   * Returns false if a page on the way cannot be fetched or has changed.
+   */
+  bool NextSibling(page_id_t page_id, page_id_t parent, page_id_t &sibling) {
+    sibling = INVALID_PAGE_ID;
+    if (parent == INVALID_PAGE_ID) {
+      return true;
+    }
+    std::vector<page_id_t> next;
+    page_id_t grand;
+    if (!Children(parent, page_id, 1, next, grand)) {
+      return false;
+    }
+    if (next.empty()) {
+      page_id_t uncle;
+      if (!NextSibling(parent, grand, uncle)) {
+        return false;
+      }
+      if (uncle == INVALID_PAGE_ID) {
+        return true;
+      }
+      if (!Children(uncle, INVALID_PAGE_ID, 1, next, grand) || next.empty()) {
+        return false;
+      }
+    }
+    sibling = next[0];
+    return true;
+  }
+
   // add your own private member variables here
   void UnlockAndUnPin() {
     bufferPoolManager->FetchPage(leafPage->GetPageId())->RUnlatch();
@@ -52,6 +176,11 @@ private:
   int Index;
   B_PLUS_TREE_LEAF_PAGE_TYPE *leafPage;
   BufferPoolManager *bufferPoolManager;
+  int aheadLeft; // leaves requested by ReadAhead not reached yet
+  page_id_t aheadParent; // internal page holding aheadLast
+  page_id_t aheadLast; // last leaf requested, the next batch starts after it
+  bool aheadAtEnd; // the batches have reached the last leaf
+  BufferAccessStrategy *strategy; // leaves are fetched under it, may be null
 };
 
 } // namespace scudb